@@ -14,6 +14,9 @@ pkgs.mkShell {
 
   buildInputs = with pkgs; [
     clang-tools
+    freetype
+    fontconfig
+    dejavu_fonts
     sdl3.dev
     spdlog
     wayland-scanner
@@ -40,4 +43,9 @@ pkgs.mkShell {
     xorg.libXau
     xorg.libXdmcp
   ];
+
+  # the default subtitle font is looked up here when its path doesn't exist
+  FONTCONFIG_FILE = pkgs.makeFontsConf {
+    fontDirectories = [ pkgs.dejavu_fonts ];
+  };
 }
@@ -0,0 +1,242 @@
+#include "audio_spectrum.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <ctime>
+
+#include <gst/audio/audio.h>
+#include <gst/gst.h>
+#include <spdlog/spdlog.h>
+
+namespace player {
+namespace {
+
+constexpr size_t kFftSize = 1024;
+constexpr size_t kRingSize = 4 * kFftSize;
+
+// analysis rate, about as often as the overlay can show a new spectrum
+constexpr auto kInterval = std::chrono::milliseconds(33);
+constexpr GstClockTime kLogInterval = 10 * GST_SECOND;
+
+constexpr double kMinHz = 40.0;
+constexpr double kFloorDb = -80.0;
+// how far a bar may fall per analysis, peaks stay readable
+constexpr float kDecay = 0.04f;
+
+// 10 us buckets up to 10 ms
+constexpr double kBucketUs = 10.0;
+constexpr size_t kBuckets = 1000;
+
+uint64_t ThreadCpuNs() {
+  timespec time;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time);
+  return static_cast<uint64_t>(time.tv_sec) * 1000000000 + time.tv_nsec;
+}
+
+float Normalize(double db) {
+  return static_cast<float>(std::clamp((db - kFloorDb) / -kFloorDb, 0.0, 1.0));
+}
+
+}  // namespace
+
+AudioSpectrum::AudioSpectrum(GstPad *pad)
+    : pad(GstPadPtr{GST_PAD(gst_object_ref(pad))}),
+      ring(kRingSize),
+      tap_us(kBucketUs, kBuckets),
+      fft(kFftSize),
+      window(dsp::HannWindow(kFftSize)),
+      samples(kFftSize),
+      re(kFftSize),
+      im(kFftSize),
+      power(kFftSize / 2),
+      analyze_us(kBucketUs, kBuckets),
+      thread(&AudioSpectrum::Run, this) {
+  gst_audio_info_init(&info);
+  probe = gst_pad_add_probe(
+      pad,
+      static_cast<GstPadProbeType>(GST_PAD_PROBE_TYPE_BUFFER |
+                                   GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM),
+      Tap, this, nullptr);
+}
+
+AudioSpectrum::~AudioSpectrum() {
+  gst_pad_remove_probe(pad.get(), probe);
+  {
+    std::lock_guard lock{mutex};
+    stop = true;
+  }
+  cv.notify_one();
+  thread.join();
+
+  LogStats();
+}
+
+AudioSpectrum::Levels AudioSpectrum::Current() {
+  std::lock_guard lock{levels_mutex};
+  return levels;
+}
+
+GstPadProbeReturn AudioSpectrum::Tap(GstPad *pad, GstPadProbeInfo *info,
+                                     gpointer user_data) {
+  auto *spectrum = static_cast<AudioSpectrum *>(user_data);
+
+  if (GST_PAD_PROBE_INFO_TYPE(info) & GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM) {
+    auto *event = GST_PAD_PROBE_INFO_EVENT(info);
+    if (GST_EVENT_TYPE(event) == GST_EVENT_CAPS) {
+      GstCaps *caps;
+      gst_event_parse_caps(event, &caps);
+      auto &audio = spectrum->info;
+      spectrum->supported =
+          gst_audio_info_from_caps(&audio, caps) &&
+          GST_AUDIO_INFO_LAYOUT(&audio) == GST_AUDIO_LAYOUT_INTERLEAVED &&
+          (GST_AUDIO_INFO_FORMAT(&audio) == GST_AUDIO_FORMAT_F32 ||
+           GST_AUDIO_INFO_FORMAT(&audio) == GST_AUDIO_FORMAT_S16);
+      if (!spectrum->supported) {
+        spdlog::warn("[spectrum] unsupported audio format, visualizer off");
+      }
+
+      std::lock_guard lock{spectrum->samples_mutex};
+      spectrum->rate = GST_AUDIO_INFO_RATE(&audio);
+    }
+    return GST_PAD_PROBE_OK;
+  }
+
+  if (!spectrum->supported) {
+    return GST_PAD_PROBE_OK;
+  }
+
+  auto start = ThreadCpuNs();
+
+  auto *buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+  GstMapInfo map;
+  if (!gst_buffer_map(buffer, &map, GST_MAP_READ)) {
+    return GST_PAD_PROBE_OK;
+  }
+
+  const auto &audio = spectrum->info;
+  int channels = GST_AUDIO_INFO_CHANNELS(&audio);
+  size_t frames = map.size / GST_AUDIO_INFO_BPF(&audio);
+  bool is_float = GST_AUDIO_INFO_FORMAT(&audio) == GST_AUDIO_FORMAT_F32;
+  const auto *f32 = reinterpret_cast<const float *>(map.data);
+  const auto *s16 = reinterpret_cast<const int16_t *>(map.data);
+
+  std::lock_guard lock{spectrum->samples_mutex};
+  auto &ring = spectrum->ring;
+  for (size_t frame = 0; frame < frames; frame++) {
+    float sum = 0;
+    for (int channel = 0; channel < channels; channel++) {
+      size_t i = frame * channels + channel;
+      sum += is_float ? f32[i] : s16[i] / 32768.f;
+    }
+    ring[spectrum->written++ % ring.size()] = sum / channels;
+  }
+  gst_buffer_unmap(buffer, &map);
+
+  auto cost = ThreadCpuNs() - start;
+  spectrum->tap_cpu_ns += cost;
+  spectrum->tap_us.Add(cost / 1e3);
+
+  return GST_PAD_PROBE_OK;
+}
+
+void AudioSpectrum::Run() {
+  window_start_ns = gst_util_get_timestamp();
+
+  while (true) {
+    {
+      std::unique_lock lock{mutex};
+      if (cv.wait_for(lock, kInterval, [this] { return stop; })) {
+        return;
+      }
+    }
+
+    auto start = ThreadCpuNs();
+
+    bool fresh = false;
+    int sample_rate = 0;
+    {
+      std::lock_guard lock{samples_mutex};
+      if (written >= kFftSize && written != analyzed) {
+        for (size_t i = 0; i < kFftSize; i++) {
+          samples[i] = ring[(written - kFftSize + i) % ring.size()];
+        }
+        analyzed = written;
+        sample_rate = rate;
+        fresh = sample_rate > 0;
+      }
+    }
+
+    if (fresh) {
+      auto next = Current();
+      Analyze(next, sample_rate);
+      std::lock_guard lock{levels_mutex};
+      levels = next;
+    }
+
+    auto cost = ThreadCpuNs() - start;
+    worker_cpu_ns += cost;
+    if (fresh) {
+      analyze_us.Add(cost / 1e3);
+    }
+
+    if (gst_util_get_timestamp() - window_start_ns >= kLogInterval) {
+      LogStats();
+    }
+  }
+}
+
+void AudioSpectrum::Analyze(Levels &next, int sample_rate) {
+  dsp::ApplyWindow(re.data(), samples.data(), window.data(), kFftSize);
+  std::fill(im.begin(), im.end(), 0.f);
+  fft.Forward(re.data(), im.data());
+  dsp::Power(re.data(), im.data(), power.data(), power.size());
+
+  // a full scale sine peaks at N/4 with a Hann window
+  double scale = 1.0 / ((kFftSize / 4.0) * (kFftSize / 4.0));
+  double bin_hz = static_cast<double>(sample_rate) / kFftSize;
+  double max_hz = sample_rate / 2.0;
+
+  for (size_t band = 0; band < kBands; band++) {
+    double low = kMinHz * std::pow(max_hz / kMinHz,
+                                   static_cast<double>(band) / kBands);
+    double high = kMinHz * std::pow(max_hz / kMinHz,
+                                    static_cast<double>(band + 1) / kBands);
+    auto first = std::clamp<size_t>(static_cast<size_t>(low / bin_hz), 1,
+                                    power.size() - 1);
+    auto last = std::clamp<size_t>(static_cast<size_t>(high / bin_hz),
+                                   first + 1, power.size());
+
+    double sum = 0;
+    for (size_t bin = first; bin < last; bin++) {
+      sum += power[bin];
+    }
+    double db = 10 * std::log10(sum / (last - first) * scale + 1e-12);
+    next.bands[band] = std::max(Normalize(db), next.bands[band] - kDecay);
+  }
+
+  double rms = dsp::Rms(samples.data(), kFftSize);
+  next.rms = Normalize(20 * std::log10(rms + 1e-9));
+}
+
+void AudioSpectrum::LogStats() {
+  auto now = gst_util_get_timestamp();
+  double elapsed = static_cast<double>(now - window_start_ns);
+  if (elapsed <= 0) {
+    return;
+  }
+
+  std::lock_guard lock{samples_mutex};
+  spdlog::info("[spectrum] cpu: worker {:.3f}%, probe {:.3f}% of a core",
+               100.0 * worker_cpu_ns / elapsed, 100.0 * tap_cpu_ns / elapsed);
+  spdlog::info("[spectrum] analysis us: {}", analyze_us.Summary());
+  spdlog::info("[spectrum] probe us: {}", tap_us.Summary());
+
+  analyze_us.Reset();
+  tap_us.Reset();
+  worker_cpu_ns = 0;
+  tap_cpu_ns = 0;
+  window_start_ns = now;
+}
+
+}  // namespace player
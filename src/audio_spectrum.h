@@ -0,0 +1,85 @@
+#pragma once
+
+#include <array>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <gst/audio/audio.h>
+#include <gst/gst.h>
+
+#include "fft.h"
+#include "gst_utils.h"
+#include "histogram.h"
+
+namespace player {
+
+// Taps decoded PCM with a pad probe and computes a log-spaced spectrum and the
+// RMS level on a worker thread. The probe only downmixes into a ring, it
+// doesn't change what reaches the audio sink. CPU time of the probe and the
+// worker is measured per thread and logged every 10 s.
+class AudioSpectrum {
+ public:
+  static constexpr size_t kBands = 32;
+
+  // normalized to [0, 1]
+  struct Levels {
+    std::array<float, kBands> bands{};
+    float rms = 0;
+  };
+
+  explicit AudioSpectrum(GstPad *pad);
+  ~AudioSpectrum();
+
+  AudioSpectrum(const AudioSpectrum &other) = delete;
+  AudioSpectrum &operator=(const AudioSpectrum &) = delete;
+
+  Levels Current();
+
+ private:
+  static GstPadProbeReturn Tap(GstPad *pad, GstPadProbeInfo *info,
+                               gpointer user_data);
+
+  void Run();
+  void Analyze(Levels &next, int sample_rate);
+  void LogStats();
+
+  GstPadPtr pad;
+  gulong probe = 0;
+
+  // streaming thread only
+  GstAudioInfo info;
+  bool supported = false;
+
+  std::mutex samples_mutex;
+  std::vector<float> ring;
+  uint64_t written = 0;
+  int rate = 0;
+  utils::Histogram tap_us;
+  uint64_t tap_cpu_ns = 0;
+
+  std::mutex levels_mutex;
+  Levels levels;
+
+  // worker thread only
+  dsp::Fft fft;
+  std::vector<float> window;
+  std::vector<float> samples;
+  std::vector<float> re;
+  std::vector<float> im;
+  std::vector<float> power;
+  uint64_t analyzed = 0;
+  utils::Histogram analyze_us;
+  uint64_t worker_cpu_ns = 0;
+  uint64_t window_start_ns = 0;
+
+  std::mutex mutex;
+  std::condition_variable cv;
+  bool stop = false;
+
+  std::thread thread;
+};
+
+}  // namespace player
@@ -0,0 +1,102 @@
+#include "clip_cache.h"
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <gst/gst.h>
+#include <spdlog/spdlog.h>
+
+namespace player {
+namespace {
+
+double ToMB(guint64 bytes) { return bytes / (1024.0 * 1024.0); }
+
+}  // namespace
+
+ClipCache::ClipCache(guint64 max_bytes)
+    : max_bytes(max_bytes), read_ms(1.0, 1000) {
+  spdlog::info("[clips] caching up to {:.1f} MB", ToMB(max_bytes));
+}
+
+ClipCache::~ClipCache() { LogStats(); }
+
+GBytesPtr ClipCache::Get(const std::string &path) {
+  GStatBuf stat;
+  if (g_stat(path.c_str(), &stat) != 0) {
+    return {nullptr, &g_bytes_unref};
+  }
+  auto size = static_cast<guint64>(stat.st_size);
+  auto mtime_ns = static_cast<guint64>(stat.st_mtim.tv_sec) * 1000000000 +
+                  stat.st_mtim.tv_nsec;
+
+  if (auto found = by_path.find(path); found != by_path.end()) {
+    auto entry = found->second;
+    if (entry->mtime_ns == mtime_ns &&
+        g_bytes_get_size(entry->bytes.get()) == size) {
+      hits++;
+      bytes_served += size;
+      entries.splice(entries.begin(), entries, entry);
+      spdlog::info("[clips] hit {} ({:.1f} MB)", path, ToMB(size));
+      return {g_bytes_ref(entry->bytes.get()), &g_bytes_unref};
+    }
+    // the file changed, read it again
+    bytes -= g_bytes_get_size(entry->bytes.get());
+    entries.erase(entry);
+    by_path.erase(found);
+  }
+
+  misses++;
+  if (size > max_bytes) {
+    bypassed++;
+    spdlog::info("[clips] {} ({:.1f} MB) is larger than the cache", path,
+                 ToMB(size));
+    return {nullptr, &g_bytes_unref};
+  }
+
+  auto start = gst_util_get_timestamp();
+  gchar *contents = nullptr;
+  gsize length = 0;
+  GError *error = nullptr;
+  if (!g_file_get_contents(path.c_str(), &contents, &length, &error)) {
+    auto err = GlibErrorPtr{error, &g_error_free};
+    spdlog::error("[clips] couldn't read {}: {}", path, err->message);
+    return {nullptr, &g_bytes_unref};
+  }
+  read_ms.Add((gst_util_get_timestamp() - start) / 1e6);
+  bytes_read += length;
+
+  Evict(length);
+  auto clip = GBytesPtr{g_bytes_new_take(contents, length), &g_bytes_unref};
+  entries.push_front(
+      Entry{path, mtime_ns, {g_bytes_ref(clip.get()), &g_bytes_unref}});
+  by_path[path] = entries.begin();
+  bytes += length;
+
+  spdlog::info("[clips] miss {} ({:.1f} MB), {:.1f} of {:.1f} MB used", path,
+               ToMB(length), ToMB(bytes), ToMB(max_bytes));
+  return clip;
+}
+
+void ClipCache::Evict(guint64 needed) {
+  while (!entries.empty() && bytes + needed > max_bytes) {
+    auto &oldest = entries.back();
+    bytes -= g_bytes_get_size(oldest.bytes.get());
+    spdlog::info("[clips] evicting {}", oldest.path);
+    by_path.erase(oldest.path);
+    entries.pop_back();
+    evictions++;
+  }
+}
+
+void ClipCache::LogStats() const {
+  spdlog::info(
+      "[clips] {} hits, {} misses ({} too large), {} evictions, {} clips "
+      "in {:.1f} MB",
+      hits, misses, bypassed, evictions, entries.size(), ToMB(bytes));
+  spdlog::info("[clips] {:.1f} MB served from memory, {:.1f} MB read",
+               ToMB(bytes_served), ToMB(bytes_read));
+  if (read_ms.Count() > 0) {
+    spdlog::info("[clips] read ms: {}", read_ms.Summary());
+  }
+}
+
+}  // namespace player
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstdint>
+#include <list>
+#include <string>
+#include <unordered_map>
+
+#include <glib.h>
+
+#include "gst_utils.h"
+#include "histogram.h"
+
+namespace player {
+
+// Keeps the compressed bytes of recently played files in memory, least
+// recently used first out once `max_bytes` is exceeded. Pipelines play the
+// bytes through a GMemoryInputStream, so clips repeated by a playlist aren't
+// read from storage again. Entries are shared by reference: evicting a clip
+// that's still playing only drops the cache's reference.
+class ClipCache {
+ public:
+  explicit ClipCache(guint64 max_bytes);
+  ~ClipCache();
+
+  ClipCache(const ClipCache &other) = delete;
+  ClipCache &operator=(const ClipCache &) = delete;
+
+  // The bytes of `path`, read on a miss. nullptr if the file can't be read
+  // or is larger than the whole cache, it's played from storage then.
+  GBytesPtr Get(const std::string &path);
+
+  void LogStats() const;
+
+ private:
+  struct Entry {
+    std::string path;
+    guint64 mtime_ns;
+    GBytesPtr bytes;
+  };
+
+  void Evict(guint64 needed);
+
+  guint64 max_bytes;
+  guint64 bytes = 0;
+
+  // most recently used first
+  std::list<Entry> entries;
+  std::unordered_map<std::string, std::list<Entry>::iterator> by_path;
+
+  uint64_t hits = 0;
+  uint64_t misses = 0;
+  uint64_t bypassed = 0;
+  uint64_t evictions = 0;
+  // hits only, misses are counted as read
+  guint64 bytes_served = 0;
+  guint64 bytes_read = 0;
+  utils::Histogram read_ms;
+};
+
+}  // namespace player
@@ -0,0 +1,235 @@
+#include "decode_throttle.h"
+
+#include <ctime>
+
+#include <gst/gst.h>
+#include <spdlog/spdlog.h>
+
+#include "tracing.h"
+
+namespace player {
+namespace {
+
+constexpr const char *kModeNames[] = {"visible", "hidden", "visible muted",
+                                      "hidden muted"};
+
+uint64_t ProcessCpuNs() {
+  timespec time;
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &time);
+  return static_cast<uint64_t>(time.tv_sec) * 1000000000 + time.tv_nsec;
+}
+
+GstClockTime Now() { return gst_util_get_timestamp(); }
+
+GstPadPtr StaticPad(GstElement *bin, const char *element, const char *pad) {
+  auto found = GstElementPtr{gst_bin_get_by_name(GST_BIN(bin), element)};
+  if (!found) {
+    return nullptr;
+  }
+  return GstPadPtr{gst_element_get_static_pad(found.get(), pad)};
+}
+
+}  // namespace
+
+DecodeThrottle::DecodeThrottle(GstElement *pipeline, bool live, bool segment)
+    : pipeline(pipeline),
+      live(live),
+      segment(segment),
+      restore_ms(1.0, 1000),
+      last_cpu_ns(ProcessCpuNs()),
+      last_wall(Now()) {
+  // after the timeshift probe, the ring keeps recording the full stream
+  video_pad = StaticPad(pipeline, "decodevideo", "sink");
+  if (!video_pad) {
+    video_pad = StaticPad(pipeline, "sinkvideo", "sink");
+    drop_all = true;
+  }
+  if (video_pad) {
+    video_probe = gst_pad_add_probe(video_pad.get(), GST_PAD_PROBE_TYPE_BUFFER,
+                                    FilterVideo, this, nullptr);
+  }
+
+  sink_pad = StaticPad(pipeline, "sinkvideo", "sink");
+  if (sink_pad) {
+    sink_probe = gst_pad_add_probe(sink_pad.get(), GST_PAD_PROBE_TYPE_BUFFER,
+                                   MeasureRestore, this, nullptr);
+  }
+
+  // in front of the decoder, muted audio isn't decoded at all
+  audio_pad = StaticPad(pipeline, "queueaudio", "src");
+  if (audio_pad) {
+    audio_probe = gst_pad_add_probe(audio_pad.get(), GST_PAD_PROBE_TYPE_BUFFER,
+                                    FilterAudio, this, nullptr);
+  }
+  audio_sink =
+      GstElementPtr{gst_bin_get_by_name(GST_BIN(pipeline), "sinkaudio")};
+}
+
+DecodeThrottle::~DecodeThrottle() {
+  if (video_probe) {
+    gst_pad_remove_probe(video_pad.get(), video_probe);
+  }
+  if (sink_probe) {
+    gst_pad_remove_probe(sink_pad.get(), sink_probe);
+  }
+  if (audio_probe) {
+    gst_pad_remove_probe(audio_pad.get(), audio_probe);
+  }
+  LogSummary();
+}
+
+GstPadProbeReturn DecodeThrottle::FilterVideo(GstPad *pad,
+                                              GstPadProbeInfo *info,
+                                              gpointer user_data) {
+  auto *throttle = static_cast<DecodeThrottle *>(user_data);
+  auto *buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+  bool delta = throttle->drop_all ||
+               GST_BUFFER_FLAG_IS_SET(buffer, GST_BUFFER_FLAG_DELTA_UNIT);
+
+  if (throttle->hidden || throttle->wait_keyframe) {
+    if (delta) {
+      throttle->dropped_video++;
+      return GST_PAD_PROBE_DROP;
+    }
+    throttle->wait_keyframe = false;
+  }
+  return GST_PAD_PROBE_OK;
+}
+
+GstPadProbeReturn DecodeThrottle::FilterAudio(GstPad *pad,
+                                              GstPadProbeInfo *info,
+                                              gpointer user_data) {
+  auto *throttle = static_cast<DecodeThrottle *>(user_data);
+  if (!throttle->muted) {
+    return GST_PAD_PROBE_OK;
+  }
+
+  // the sink keeps advancing through the gap as if it played silence
+  auto *buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+  if (GST_BUFFER_PTS_IS_VALID(buffer)) {
+    gst_pad_push_event(pad, gst_event_new_gap(GST_BUFFER_PTS(buffer),
+                                              GST_BUFFER_DURATION(buffer)));
+  }
+  throttle->dropped_audio++;
+  return GST_PAD_PROBE_DROP;
+}
+
+GstPadProbeReturn DecodeThrottle::MeasureRestore(GstPad *pad,
+                                                 GstPadProbeInfo *info,
+                                                 gpointer user_data) {
+  auto *throttle = static_cast<DecodeThrottle *>(user_data);
+  auto start = throttle->restore_start.exchange(GST_CLOCK_TIME_NONE);
+  if (GST_CLOCK_TIME_IS_VALID(start)) {
+    auto elapsed = (Now() - start) / 1e6;
+    throttle->restore_ms.Add(elapsed);
+    tracing::Counter("restore ms", elapsed);
+  }
+  return GST_PAD_PROBE_OK;
+}
+
+void DecodeThrottle::Account() {
+  auto cpu = ProcessCpuNs();
+  auto wall = Now();
+  auto &mode = usage[Mode()];
+  mode.cpu_s += (cpu - last_cpu_ns) / 1e9;
+  mode.wall_s += static_cast<double>(wall - last_wall) / GST_SECOND;
+  last_cpu_ns = cpu;
+  last_wall = wall;
+}
+
+void DecodeThrottle::SetVisible(bool visible) {
+  if (visible != hidden) {
+    return;
+  }
+  Account();
+  hidden = !visible;
+
+  if (!visible) {
+    spdlog::info("[throttle] hidden, {}",
+                 drop_all ? "dropping video" : "decoding keyframes only");
+    return;
+  }
+
+  auto start = Now();
+  if (live) {
+    // the decoder lacks the references of the dropped frames
+    wait_keyframe = !drop_all;
+    restore_start = start;
+    spdlog::info("[throttle] visible, resuming at the next keyframe");
+    return;
+  }
+
+  gint64 position;
+  if (!gst_element_query_position(pipeline, GST_FORMAT_TIME, &position)) {
+    spdlog::warn("[throttle] no position, resuming at the next keyframe");
+    wait_keyframe = true;
+    restore_start = start;
+    return;
+  }
+
+  // decodes from the previous keyframe, frames before the position are
+  // clipped so the first one shown is the current one at full quality
+  auto flags = static_cast<GstSeekFlags>(
+      GST_SEEK_FLAG_FLUSH | GST_SEEK_FLAG_ACCURATE |
+      (segment ? GST_SEEK_FLAG_SEGMENT : 0));
+  if (!gst_element_seek(pipeline, rate, GST_FORMAT_TIME, flags,
+                        GST_SEEK_TYPE_SET, position, GST_SEEK_TYPE_NONE,
+                        GST_CLOCK_TIME_NONE)) {
+    spdlog::warn("[throttle] seek failed, resuming at the next keyframe");
+    wait_keyframe = true;
+  }
+  restore_start = start;
+  spdlog::info("[throttle] visible, restoring at {:.3f} s",
+               static_cast<double>(position) / GST_SECOND);
+}
+
+void DecodeThrottle::SetMuted(bool muted) {
+  if (muted == this->muted) {
+    return;
+  }
+  if (!audio_pad) {
+    spdlog::info("[throttle] no audio to mute");
+    return;
+  }
+  Account();
+  this->muted = muted;
+
+  // silences what's already decoded and queued in the sink
+  if (audio_sink) {
+    g_object_set(audio_sink.get(), "mute", muted ? TRUE : FALSE, NULL);
+  }
+  spdlog::info("[throttle] {}", muted ? "muted, audio decoding stopped"
+                                      : "unmuted");
+}
+
+void DecodeThrottle::LogSummary() {
+  Account();
+
+  const auto &full = usage[0];
+  double full_share = full.wall_s > 0.0 ? full.cpu_s / full.wall_s : 0.0;
+  for (size_t i = 0; i < usage.size(); i++) {
+    if (usage[i].wall_s <= 0.0) {
+      continue;
+    }
+    auto share = usage[i].cpu_s / usage[i].wall_s;
+    if (i == 0 || full_share <= 0.0) {
+      spdlog::info("[throttle] {}: {:.1f}% of a core over {:.1f} s",
+                   kModeNames[i], share * 100.0, usage[i].wall_s);
+    } else {
+      spdlog::info(
+          "[throttle] {}: {:.1f}% of a core over {:.1f} s, {:.0f}% less",
+          kModeNames[i], share * 100.0, usage[i].wall_s,
+          (1.0 - share / full_share) * 100.0);
+    }
+  }
+  if (dropped_video > 0 || dropped_audio > 0) {
+    spdlog::info("[throttle] dropped {} video and {} audio buffers",
+                 dropped_video.load(), dropped_audio.load());
+  }
+  if (restore_ms.Count() > 0) {
+    spdlog::info("[throttle] visible to first frame ms: {}",
+                 restore_ms.Summary());
+  }
+}
+
+}  // namespace player
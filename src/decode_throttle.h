@@ -0,0 +1,87 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+#include <gst/gst.h>
+
+#include "gst_utils.h"
+#include "histogram.h"
+
+namespace player {
+
+// Cuts decode work nobody sees or hears. While no video window is visible
+// only keyframes reach the video decoder (raw live video is dropped
+// altogether), while muted the audio decoder gets nothing and the sink gets
+// gap events instead, so the clock and the audio/video sync keep running.
+//
+// When a window becomes visible again a file is seeked accurately to the
+// current position, so the first frame shown is fully decoded. Live streams
+// can't seek and keep dropping until the next keyframe. Process CPU time is
+// accounted per mode to report the savings.
+class DecodeThrottle {
+ public:
+  // `segment` keeps the segment seeks of --loop going
+  DecodeThrottle(GstElement *pipeline, bool live, bool segment);
+  ~DecodeThrottle();
+
+  DecodeThrottle(const DecodeThrottle &other) = delete;
+  DecodeThrottle &operator=(const DecodeThrottle &) = delete;
+
+  void SetVisible(bool visible);
+  void SetMuted(bool muted);
+  bool Muted() const { return muted; }
+  // The rate restoring seeks play at.
+  void SetRate(double rate) { this->rate = rate; }
+
+  void LogSummary();
+
+ private:
+  static GstPadProbeReturn FilterVideo(GstPad *pad, GstPadProbeInfo *info,
+                                       gpointer user_data);
+  static GstPadProbeReturn FilterAudio(GstPad *pad, GstPadProbeInfo *info,
+                                       gpointer user_data);
+  static GstPadProbeReturn MeasureRestore(GstPad *pad, GstPadProbeInfo *info,
+                                          gpointer user_data);
+
+  // charges the CPU time since the last change to the current mode
+  void Account();
+  size_t Mode() const { return (hidden ? 1 : 0) | (muted ? 2 : 0); }
+
+  GstElement *pipeline;
+  bool live;
+  bool segment;
+  double rate = 1.0;
+  // without a decoder there are no keyframes to keep
+  bool drop_all = false;
+
+  GstPadPtr video_pad;
+  gulong video_probe = 0;
+  GstPadPtr audio_pad;
+  gulong audio_probe = 0;
+  GstPadPtr sink_pad;
+  gulong sink_probe = 0;
+  GstElementPtr audio_sink;
+
+  std::atomic<bool> hidden = false;
+  std::atomic<bool> muted = false;
+  // a live stream resumes at the next keyframe
+  std::atomic<bool> wait_keyframe = false;
+  std::atomic<GstClockTime> restore_start = GST_CLOCK_TIME_NONE;
+
+  std::atomic<uint64_t> dropped_video = 0;
+  std::atomic<uint64_t> dropped_audio = 0;
+  // written by the video sink streaming thread only
+  utils::Histogram restore_ms;
+
+  struct Usage {
+    double cpu_s = 0.0;
+    double wall_s = 0.0;
+  };
+  std::array<Usage, 4> usage;
+  uint64_t last_cpu_ns;
+  GstClockTime last_wall;
+};
+
+}  // namespace player
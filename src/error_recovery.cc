@@ -0,0 +1,215 @@
+#include "error_recovery.h"
+
+#include <string_view>
+
+#include <gst/gst.h>
+#include <spdlog/spdlog.h>
+
+#include "tracing.h"
+
+namespace player {
+namespace {
+
+// consecutive corrupt frames a decoder may drop before it posts an error
+constexpr int kMaxDecodeErrors = 50;
+
+constexpr size_t kMaxAttempts = 5;
+constexpr GstClockTime kAttemptWindow = 30 * GST_SECOND;
+// error free playback after which a failure counts as a new outage
+constexpr GstClockTime kStableTime = 5 * GST_SECOND;
+// how much further every consecutive attempt skips past the last good position
+constexpr GstClockTime kSkipStep = 500 * GST_MSECOND;
+constexpr GstClockTime kTrackInterval = 100 * GST_MSECOND;
+// wait before retrying a seek that failed, longer on every failed attempt
+constexpr GstClockTime kRetryDelay = 200 * GST_MSECOND;
+
+// 5 ms buckets up to 5 s
+constexpr double kBucketMs = 5.0;
+constexpr size_t kBuckets = 1000;
+
+GstClockTime Now() { return gst_util_get_timestamp(); }
+
+double ToMs(GstClockTime time) { return static_cast<double>(time) / 1e6; }
+
+bool HasProperty(GstElement *element, const char *name) {
+  return g_object_class_find_property(G_OBJECT_GET_CLASS(element), name);
+}
+
+// only elements the player created itself are restarted, live sources too
+// since they have no position to lose
+bool IsRestartable(GstElement *element, bool live) {
+  auto *factory = gst_element_get_factory(element);
+  if (!factory) {
+    return false;
+  }
+  std::string_view klass =
+      gst_element_factory_get_metadata(factory, GST_ELEMENT_METADATA_KLASS);
+  return klass.find("Decoder") != std::string_view::npos ||
+         klass.find("Sink") != std::string_view::npos ||
+         (live && klass.find("Source") != std::string_view::npos);
+}
+
+}  // namespace
+
+void ConcealDecodeErrors(GstElement *decoder) {
+  if (HasProperty(decoder, "max-errors")) {
+    g_object_set(decoder, "max-errors", kMaxDecodeErrors, NULL);
+  }
+  // show the last good frame instead of a corrupted one
+  if (HasProperty(decoder, "discard-corrupted-frames")) {
+    g_object_set(decoder, "discard-corrupted-frames", TRUE, NULL);
+  }
+}
+
+ErrorRecovery::ErrorRecovery(GstElement *pipeline, bool live, bool segment)
+    : pipeline(pipeline),
+      live(live),
+      segment(segment),
+      recovery_ms(kBucketMs, kBuckets) {}
+
+ErrorRecovery::~ErrorRecovery() { LogSummary(); }
+
+void ErrorRecovery::LogSummary() const {
+  if (errors == 0) {
+    return;
+  }
+  spdlog::info("[recovery] {} errors, {} recoveries, recovery ms: {}", errors,
+               recoveries, recovery_ms.Summary());
+}
+
+void ErrorRecovery::Track() {
+  auto now = Now();
+  if (pending || recovering ||
+      (GST_CLOCK_TIME_IS_VALID(last_track) &&
+       now - last_track < kTrackInterval)) {
+    return;
+  }
+  last_track = now;
+
+  if (consecutive > 0 && now - healthy_since >= kStableTime) {
+    consecutive = 0;
+  }
+
+  gint64 position;
+  if (!live &&
+      gst_element_query_position(pipeline, GST_FORMAT_TIME, &position)) {
+    last_good = position;
+  }
+}
+
+void ErrorRecovery::OnError(GstMessage *msg) {
+  errors++;
+  if (!pending && !recovering) {
+    error_time = Now();
+    tracing::Instant("error");
+  }
+  pending = true;
+
+  // the first error names the culprit, the rest are fallout upstream
+  if (!failed_element && GST_IS_ELEMENT(GST_MESSAGE_SRC(msg))) {
+    failed_element = GstElementPtr{
+        GST_ELEMENT(gst_object_ref(GST_MESSAGE_SRC(msg)))};
+  }
+}
+
+void ErrorRecovery::RestartElement(GstElement *element) {
+  spdlog::info("[recovery] restarting {}", GetObjectName(element));
+  gst_element_set_state(element, GST_STATE_NULL);
+  gst_element_sync_state_with_parent(element);
+}
+
+bool ErrorRecovery::Pending() const {
+  return pending &&
+         (!GST_CLOCK_TIME_IS_VALID(retry_time) || Now() >= retry_time);
+}
+
+bool ErrorRecovery::Recover() {
+  pending = false;
+  retry_time = GST_CLOCK_TIME_NONE;
+  auto now = Now();
+
+  while (!attempts.empty() && now - attempts.front() > kAttemptWindow) {
+    attempts.pop_front();
+  }
+  if (attempts.size() >= kMaxAttempts) {
+    spdlog::error("[recovery] giving up after {} attempts in {} s",
+                  attempts.size(), kAttemptWindow / GST_SECOND);
+    return false;
+  }
+  attempts.push_back(now);
+  consecutive++;
+
+  bool restart = failed_element && IsRestartable(failed_element.get(), live);
+  if (restart) {
+    RestartElement(failed_element.get());
+  }
+
+  recovering = true;
+
+  if (live) {
+    // live sources can't seek, the restarted element picks up where the
+    // stream is; only an error nobody can be blamed for restarts everything
+    if (restart) {
+      restarted = std::move(failed_element);
+    } else {
+      spdlog::info("[recovery] restarting the live pipeline, attempt {}",
+                   consecutive);
+      gst_element_set_state(pipeline, GST_STATE_READY);
+      gst_element_set_state(pipeline, GST_STATE_PLAYING);
+    }
+    failed_element.reset();
+    return true;
+  }
+  failed_element.reset();
+
+  GstClockTime position = GST_CLOCK_TIME_IS_VALID(last_good) ? last_good : 0;
+  position += (consecutive - 1) * kSkipStep;
+
+  // snapping after skips the rest of a corrupt GOP
+  auto flags = static_cast<GstSeekFlags>(
+      GST_SEEK_FLAG_FLUSH | GST_SEEK_FLAG_KEY_UNIT | GST_SEEK_FLAG_SNAP_AFTER |
+      (segment ? GST_SEEK_FLAG_SEGMENT : 0));
+  spdlog::info("[recovery] seeking to {:.3f} s, attempt {}",
+               static_cast<double>(position) / GST_SECOND, consecutive);
+  if (!gst_element_seek(pipeline, rate, GST_FORMAT_TIME, flags,
+                        GST_SEEK_TYPE_SET, position, GST_SEEK_TYPE_NONE,
+                        GST_CLOCK_TIME_NONE)) {
+    // counted as an attempt, retried after a growing delay
+    spdlog::error("[recovery] seek failed");
+    recovering = false;
+    pending = true;
+    retry_time = Now() + consecutive * kRetryDelay;
+  }
+  return true;
+}
+
+void ErrorRecovery::OnStateChanged(GstMessage *msg) {
+  GstState new_state;
+  gst_message_parse_state_changed(msg, nullptr, &new_state, nullptr);
+  if (new_state != GST_STATE_PLAYING) {
+    return;
+  }
+  auto *src = GST_MESSAGE_SRC(msg);
+  if (src == GST_OBJECT(pipeline) ||
+      (restarted && src == GST_OBJECT(restarted.get()))) {
+    OnPlaying();
+  }
+}
+
+void ErrorRecovery::OnPlaying() {
+  if (!recovering) {
+    return;
+  }
+  recovering = false;
+  restarted.reset();
+  recoveries++;
+
+  auto now = Now();
+  healthy_since = now;
+  auto elapsed = ToMs(now - error_time);
+  recovery_ms.Add(elapsed);
+  tracing::Counter("recovery ms", elapsed);
+  spdlog::info("[recovery] playing again {:.1f} ms after the error", elapsed);
+}
+
+}  // namespace player
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+
+#include <gst/gst.h>
+
+#include "gst_utils.h"
+#include "histogram.h"
+
+namespace player {
+
+// Lets decoders drop corrupt frames (with a warning) instead of failing the
+// stream, so a bad slice costs a few frames without any recovery at all.
+void ConcealDecodeErrors(GstElement *decoder);
+
+// Recovers from error messages in place instead of ending the process. The
+// failing decoder or sink is restarted, then files are repositioned with a
+// flushing seek to the last good position (skipping further ahead on every
+// consecutive failure), live inputs only restart the failing element. Attempts
+// are limited per time window, failed seeks are retried after a delay, the
+// time from the error until the pipeline is playing again is logged.
+class ErrorRecovery {
+ public:
+  // `segment` keeps the segment seeks of --loop going after a recovery
+  ErrorRecovery(GstElement *pipeline, bool live, bool segment);
+  ~ErrorRecovery();
+
+  ErrorRecovery(const ErrorRecovery &other) = delete;
+  ErrorRecovery &operator=(const ErrorRecovery &) = delete;
+
+  // Remembers the last good position, rate limited.
+  void Track();
+
+  void OnError(GstMessage *msg);
+  // ASYNC_DONE.
+  void OnPlaying();
+  // The pipeline or a restarted live element reaching PLAYING, live inputs
+  // don't preroll.
+  void OnStateChanged(GstMessage *msg);
+
+  // The rate recovery seeks play at.
+  void SetRate(double rate) { this->rate = rate; }
+
+  // An error waits for recovery and its retry delay has passed.
+  bool Pending() const;
+  // Returns false once the retry limit is exhausted.
+  bool Recover();
+
+  uint64_t Recoveries() const { return recoveries; }
+
+  void LogSummary() const;
+
+ private:
+  void RestartElement(GstElement *element);
+
+  GstElement *pipeline;
+  bool live;
+  bool segment;
+  double rate = 1.0;
+
+  GstClockTime last_good = GST_CLOCK_TIME_NONE;
+  GstClockTime last_track = GST_CLOCK_TIME_NONE;
+
+  bool pending = false;
+  bool recovering = false;
+  GstElementPtr failed_element;
+  // restarted element of a live input, recovered once it plays
+  GstElementPtr restarted;
+  GstClockTime retry_time = GST_CLOCK_TIME_NONE;
+  // wall clock time of the first error of the current outage
+  GstClockTime error_time = GST_CLOCK_TIME_NONE;
+
+  std::deque<GstClockTime> attempts;
+  unsigned consecutive = 0;
+  GstClockTime healthy_since = GST_CLOCK_TIME_NONE;
+
+  uint64_t errors = 0;
+  uint64_t recoveries = 0;
+  utils::Histogram recovery_ms;
+};
+
+}  // namespace player
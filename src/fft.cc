@@ -0,0 +1,188 @@
+#include "fft.h"
+
+#include <cmath>
+#include <numbers>
+#include <utility>
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#define PLAYER_NEON 1
+#elif defined(__SSE2__)
+#include <xmmintrin.h>
+#define PLAYER_SSE 1
+#endif
+
+namespace player::dsp {
+namespace {
+
+constexpr size_t kLanes = 4;
+
+void Butterflies(float *re, float *im, const float *w_re, const float *w_im,
+                 size_t half) {
+  size_t j = 0;
+#if defined(PLAYER_NEON)
+  for (; j + kLanes <= half; j += kLanes) {
+    float32x4_t wr = vld1q_f32(w_re + j);
+    float32x4_t wi = vld1q_f32(w_im + j);
+    float32x4_t ar = vld1q_f32(re + j);
+    float32x4_t ai = vld1q_f32(im + j);
+    float32x4_t br = vld1q_f32(re + j + half);
+    float32x4_t bi = vld1q_f32(im + j + half);
+    float32x4_t tr = vmlsq_f32(vmulq_f32(br, wr), bi, wi);
+    float32x4_t ti = vmlaq_f32(vmulq_f32(br, wi), bi, wr);
+    vst1q_f32(re + j + half, vsubq_f32(ar, tr));
+    vst1q_f32(im + j + half, vsubq_f32(ai, ti));
+    vst1q_f32(re + j, vaddq_f32(ar, tr));
+    vst1q_f32(im + j, vaddq_f32(ai, ti));
+  }
+#elif defined(PLAYER_SSE)
+  for (; j + kLanes <= half; j += kLanes) {
+    __m128 wr = _mm_loadu_ps(w_re + j);
+    __m128 wi = _mm_loadu_ps(w_im + j);
+    __m128 ar = _mm_loadu_ps(re + j);
+    __m128 ai = _mm_loadu_ps(im + j);
+    __m128 br = _mm_loadu_ps(re + j + half);
+    __m128 bi = _mm_loadu_ps(im + j + half);
+    __m128 tr = _mm_sub_ps(_mm_mul_ps(br, wr), _mm_mul_ps(bi, wi));
+    __m128 ti = _mm_add_ps(_mm_mul_ps(br, wi), _mm_mul_ps(bi, wr));
+    _mm_storeu_ps(re + j + half, _mm_sub_ps(ar, tr));
+    _mm_storeu_ps(im + j + half, _mm_sub_ps(ai, ti));
+    _mm_storeu_ps(re + j, _mm_add_ps(ar, tr));
+    _mm_storeu_ps(im + j, _mm_add_ps(ai, ti));
+  }
+#endif
+  for (; j < half; j++) {
+    float tr = re[j + half] * w_re[j] - im[j + half] * w_im[j];
+    float ti = re[j + half] * w_im[j] + im[j + half] * w_re[j];
+    re[j + half] = re[j] - tr;
+    im[j + half] = im[j] - ti;
+    re[j] += tr;
+    im[j] += ti;
+  }
+}
+
+}  // namespace
+
+Fft::Fft(size_t size)
+    : size(size),
+      bit_reverse(size),
+      twiddle_re(size > 0 ? size - 1 : 0),
+      twiddle_im(size > 0 ? size - 1 : 0) {
+  size_t bits = 0;
+  while ((size_t{1} << bits) < size) {
+    bits++;
+  }
+  for (size_t i = 0; i < size; i++) {
+    size_t reversed = 0;
+    for (size_t b = 0; b < bits; b++) {
+      reversed |= ((i >> b) & 1) << (bits - 1 - b);
+    }
+    bit_reverse[i] = reversed;
+  }
+
+  for (size_t half = 1; half < size; half *= 2) {
+    for (size_t j = 0; j < half; j++) {
+      double angle = -std::numbers::pi * j / half;
+      twiddle_re[half - 1 + j] = static_cast<float>(std::cos(angle));
+      twiddle_im[half - 1 + j] = static_cast<float>(std::sin(angle));
+    }
+  }
+}
+
+void Fft::Forward(float *re, float *im) const {
+  for (size_t i = 0; i < size; i++) {
+    if (i < bit_reverse[i]) {
+      std::swap(re[i], re[bit_reverse[i]]);
+      std::swap(im[i], im[bit_reverse[i]]);
+    }
+  }
+
+  for (size_t half = 1; half < size; half *= 2) {
+    const float *w_re = twiddle_re.data() + half - 1;
+    const float *w_im = twiddle_im.data() + half - 1;
+    for (size_t start = 0; start < size; start += 2 * half) {
+      Butterflies(re + start, im + start, w_re, w_im, half);
+    }
+  }
+}
+
+std::vector<float> HannWindow(size_t size) {
+  std::vector<float> window(size);
+  for (size_t i = 0; i < size; i++) {
+    window[i] = static_cast<float>(
+        0.5 - 0.5 * std::cos(2 * std::numbers::pi * i / (size - 1)));
+  }
+  return window;
+}
+
+void ApplyWindow(float *dst, const float *src, const float *window,
+                 size_t count) {
+  size_t i = 0;
+#if defined(PLAYER_NEON)
+  for (; i + kLanes <= count; i += kLanes) {
+    vst1q_f32(dst + i, vmulq_f32(vld1q_f32(src + i), vld1q_f32(window + i)));
+  }
+#elif defined(PLAYER_SSE)
+  for (; i + kLanes <= count; i += kLanes) {
+    _mm_storeu_ps(dst + i,
+                  _mm_mul_ps(_mm_loadu_ps(src + i), _mm_loadu_ps(window + i)));
+  }
+#endif
+  for (; i < count; i++) {
+    dst[i] = src[i] * window[i];
+  }
+}
+
+void Power(const float *re, const float *im, float *power, size_t count) {
+  size_t i = 0;
+#if defined(PLAYER_NEON)
+  for (; i + kLanes <= count; i += kLanes) {
+    float32x4_t r = vld1q_f32(re + i);
+    float32x4_t m = vld1q_f32(im + i);
+    vst1q_f32(power + i, vmlaq_f32(vmulq_f32(r, r), m, m));
+  }
+#elif defined(PLAYER_SSE)
+  for (; i + kLanes <= count; i += kLanes) {
+    __m128 r = _mm_loadu_ps(re + i);
+    __m128 m = _mm_loadu_ps(im + i);
+    _mm_storeu_ps(power + i, _mm_add_ps(_mm_mul_ps(r, r), _mm_mul_ps(m, m)));
+  }
+#endif
+  for (; i < count; i++) {
+    power[i] = re[i] * re[i] + im[i] * im[i];
+  }
+}
+
+float Rms(const float *samples, size_t count) {
+  if (count == 0) {
+    return 0;
+  }
+
+  float sum = 0;
+  size_t i = 0;
+#if defined(PLAYER_NEON)
+  float32x4_t acc = vdupq_n_f32(0);
+  for (; i + kLanes <= count; i += kLanes) {
+    float32x4_t s = vld1q_f32(samples + i);
+    acc = vmlaq_f32(acc, s, s);
+  }
+  float lanes[kLanes];
+  vst1q_f32(lanes, acc);
+  sum = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+#elif defined(PLAYER_SSE)
+  __m128 acc = _mm_setzero_ps();
+  for (; i + kLanes <= count; i += kLanes) {
+    __m128 s = _mm_loadu_ps(samples + i);
+    acc = _mm_add_ps(acc, _mm_mul_ps(s, s));
+  }
+  float lanes[kLanes];
+  _mm_storeu_ps(lanes, acc);
+  sum = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+#endif
+  for (; i < count; i++) {
+    sum += samples[i] * samples[i];
+  }
+  return std::sqrt(sum / count);
+}
+
+}  // namespace player::dsp
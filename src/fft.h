@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+namespace player::dsp {
+
+// In-place radix-2 complex FFT on split real/imaginary arrays. The butterflies
+// of every stage wider than the vector width run on NEON or SSE when
+// available, twiddles are stored per stage so they're loaded contiguously.
+class Fft {
+ public:
+  // `size` must be a power of two
+  explicit Fft(size_t size);
+
+  size_t Size() const { return size; }
+  void Forward(float *re, float *im) const;
+
+ private:
+  size_t size;
+  std::vector<size_t> bit_reverse;
+  // stage s (half width h = 2^s) uses h twiddles starting at offset h - 1
+  std::vector<float> twiddle_re;
+  std::vector<float> twiddle_im;
+};
+
+// Hann window of `size` samples.
+std::vector<float> HannWindow(size_t size);
+
+// dst[i] = src[i] * window[i]
+void ApplyWindow(float *dst, const float *src, const float *window,
+                 size_t count);
+
+// power[i] = re[i]^2 + im[i]^2
+void Power(const float *re, const float *im, float *power, size_t count);
+
+float Rms(const float *samples, size_t count);
+
+}  // namespace player::dsp
@@ -0,0 +1,198 @@
+#include "frame_scheduler.h"
+
+#include <algorithm>
+#include <vector>
+
+#include <SDL3/SDL.h>
+#include <spdlog/spdlog.h>
+
+#include "tracing.h"
+
+namespace player {
+namespace {
+
+constexpr float kDefaultRefreshRate = 60.f;
+constexpr Uint64 kLogIntervalNs = 10 * SDL_NS_PER_SECOND;
+
+// 0.5 ms buckets up to 64 ms
+constexpr double kBucketMs = 0.5;
+constexpr size_t kBuckets = 128;
+
+double ToMs(Uint64 ns) { return static_cast<double>(ns) / 1e6; }
+
+// Bars from `over_budget` on are red.
+void DrawHistogram(SDL_Renderer *renderer, const utils::Histogram &histogram,
+                   const SDL_FRect &area, size_t over_budget) {
+  const auto &buckets = histogram.Buckets();
+
+  auto highest = std::max_element(buckets.begin(), buckets.end());
+  if (highest == buckets.end() || *highest == 0) {
+    return;
+  }
+
+  float bar_width = area.w / buckets.size();
+
+  std::vector<SDL_FRect> good;
+  std::vector<SDL_FRect> bad;
+  for (size_t i = 0; i < buckets.size(); i++) {
+    if (buckets[i] == 0) {
+      continue;
+    }
+    float height = area.h * buckets[i] / *highest;
+    auto bar = SDL_FRect{area.x + i * bar_width, area.y + area.h - height,
+                         std::max(bar_width, 1.f), height};
+    (i < over_budget ? good : bad).push_back(bar);
+  }
+
+  SDL_SetRenderDrawColor(renderer, 128, 172, 62, 200);
+  SDL_RenderFillRects(renderer, good.data(), static_cast<int>(good.size()));
+  SDL_SetRenderDrawColor(renderer, 220, 50, 50, 200);
+  SDL_RenderFillRects(renderer, bad.data(), static_cast<int>(bad.size()));
+}
+
+}  // namespace
+
+FrameScheduler::FrameScheduler(SDL_Window *window)
+    : frame_times(kBucketMs, kBuckets),
+      lateness(kBucketMs, kBuckets),
+      total_frame_times(kBucketMs, kBuckets),
+      total_lateness(kBucketMs, kBuckets) {
+  UpdateRefreshRate(window);
+}
+
+int FrameScheduler::AddSurface(const std::string &name,
+                               SDL_Renderer *renderer) {
+  // marked as vsynced so SetVSync really turns it off
+  auto &surface = surfaces.emplace_back(
+      Surface{"RenderPresent " + name, renderer, true, true});
+  SetVSync(surface, false);
+  return static_cast<int>(surfaces.size() - 1);
+}
+
+void FrameScheduler::SetVSync(Surface &surface, bool vsync) {
+  if (surface.vsync == vsync) {
+    return;
+  }
+  if (!SDL_SetRenderVSync(surface.renderer, vsync ? 1 : 0)) {
+    spdlog::error("Error setting VSync! {}", SDL_GetError());
+    return;
+  }
+  surface.vsync = vsync;
+}
+
+void FrameScheduler::Invalidate(int surface) { surfaces[surface].dirty = true; }
+
+void FrameScheduler::UpdateRefreshRate(SDL_Window *window) {
+  float refresh_rate = kDefaultRefreshRate;
+
+  const auto *mode = SDL_GetCurrentDisplayMode(SDL_GetDisplayForWindow(window));
+  if (mode && mode->refresh_rate > 0) {
+    refresh_rate = mode->refresh_rate;
+  } else {
+    spdlog::warn("Unknown refresh rate, assuming {} Hz", refresh_rate);
+  }
+
+  period_ns = static_cast<Uint64>(SDL_NS_PER_SECOND / refresh_rate);
+  spdlog::info("Frame scheduler: {:.2f} Hz, period {:.2f} ms", refresh_rate,
+               PeriodMs());
+}
+
+void FrameScheduler::Present() {
+  auto now = SDL_GetTicksNS();
+  if (deadline_ns == 0) {
+    deadline_ns = now;
+    last_log_ns = now;
+  }
+
+  if (now < deadline_ns) {
+    tracing::Span span{"WaitDeadline"};
+    SDL_DelayNS(deadline_ns - now);
+    now = SDL_GetTicksNS();
+  }
+
+  // past half a period the present lands on the following refresh
+  auto late = now - deadline_ns;
+  if (late > period_ns / 2) {
+    missed++;
+    total_missed++;
+    lateness.Add(ToMs(late));
+    total_lateness.Add(ToMs(late));
+  }
+
+  // skip the deadlines we have already missed to stay in phase
+  deadline_ns += period_ns * (1 + late / period_ns);
+
+  if (last_tick_ns != 0) {
+    auto frame_time = ToMs(now - last_tick_ns);
+    frame_times.Add(frame_time);
+    total_frame_times.Add(frame_time);
+    tracing::Counter("frame time ms", frame_time);
+  }
+  last_tick_ns = now;
+
+  // only the last dirty surface waits for the refresh, the rest return at
+  // once
+  Surface *synced = nullptr;
+  for (auto &surface : surfaces) {
+    if (surface.dirty) {
+      synced = &surface;
+    } else {
+      skipped++;
+    }
+  }
+  for (auto &surface : surfaces) {
+    if (!surface.dirty) {
+      continue;
+    }
+    SetVSync(surface, &surface == synced);
+    tracing::Span span{surface.span_name.c_str()};
+    SDL_RenderPresent(surface.renderer);
+    surface.dirty = false;
+    presented++;
+  }
+  // the present returned at a refresh, the next one is a period later
+  if (synced) {
+    deadline_ns = SDL_GetTicksNS() + period_ns;
+  }
+
+  if (now - last_log_ns >= kLogIntervalNs) {
+    LogStats();
+    last_log_ns = now;
+  }
+}
+
+void FrameScheduler::LogStats() {
+  spdlog::info("[frames] time ms: {}, presented {}, skipped {}",
+               frame_times.Summary(), presented, skipped);
+  if (missed > 0) {
+    spdlog::info("[frames] missed {} deadlines, late ms: {}", missed,
+                 lateness.Summary());
+  }
+
+  frame_times.Reset();
+  lateness.Reset();
+  presented = 0;
+  skipped = 0;
+  missed = 0;
+}
+
+void FrameScheduler::LogSummary() const {
+  spdlog::info("[frames] session time ms: {}", total_frame_times.Summary());
+  spdlog::info("[frames] session missed {} deadlines, late ms: {}",
+               total_missed, total_lateness.Summary());
+}
+
+void DrawFrameTimes(SDL_Renderer *renderer, const FrameScheduler &scheduler,
+                    const SDL_FRect &area) {
+  auto frame_area = SDL_FRect{area.x, area.y, area.w, area.h * 2 / 3};
+  auto late_area = SDL_FRect{area.x, frame_area.y + frame_area.h, area.w,
+                             area.h - frame_area.h};
+  const auto &frame_times = scheduler.FrameTimes();
+  auto over_budget =
+      static_cast<size_t>(scheduler.PeriodMs() / frame_times.BucketWidth()) + 1;
+  DrawHistogram(renderer, frame_times, frame_area, over_budget);
+  // every bucket of the lateness is a missed refresh
+  DrawHistogram(renderer, scheduler.Lateness(), late_area, 0);
+}
+
+}  // namespace player
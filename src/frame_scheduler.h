@@ -0,0 +1,75 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <SDL3/SDL.h>
+
+#include "histogram.h"
+
+namespace player {
+
+// Paces the SDL loop to the display refresh and presents only the surfaces
+// that were invalidated since the last frame. Video is presented by the sink
+// on its own subsurface, so the SDL surfaces rarely need a new buffer.
+class FrameScheduler {
+ public:
+  explicit FrameScheduler(SDL_Window *window);
+
+  // Per frame one present waits for vsync and the deadlines are taken from
+  // when it returns, so sleeping to them keeps presents in phase with
+  // vblank. The other surfaces are presented without vsync, a frame never
+  // waits for more than one refresh.
+  int AddSurface(const std::string &name, SDL_Renderer *renderer);
+  void Invalidate(int surface);
+
+  void UpdateRefreshRate(SDL_Window *window);
+
+  // Sleeps until the next refresh deadline, then presents the invalidated
+  // surfaces.
+  void Present();
+
+  const utils::Histogram &FrameTimes() const { return frame_times; }
+  const utils::Histogram &Lateness() const { return lateness; }
+  double PeriodMs() const { return period_ns / 1e6; }
+
+  // Logs and resets the statistics of the current reporting window.
+  void LogStats();
+  void LogSummary() const;
+
+ private:
+  struct Surface {
+    std::string span_name;
+    SDL_Renderer *renderer;
+    bool dirty;
+    bool vsync;
+  };
+
+  void SetVSync(Surface &surface, bool vsync);
+
+  std::vector<Surface> surfaces;
+
+  Uint64 period_ns = 0;
+  Uint64 deadline_ns = 0;
+  Uint64 last_tick_ns = 0;
+  Uint64 last_log_ns = 0;
+
+  uint64_t presented = 0;
+  uint64_t skipped = 0;
+  uint64_t missed = 0;
+
+  // frame times and lateness of missed deadlines in ms, the current
+  // reporting window and the whole session
+  utils::Histogram frame_times;
+  utils::Histogram lateness;
+  utils::Histogram total_frame_times;
+  utils::Histogram total_lateness;
+  uint64_t total_missed = 0;
+};
+
+// Draws the frame time histogram, bars over the refresh period are red, and
+// below it the lateness of missed deadlines.
+void DrawFrameTimes(SDL_Renderer *renderer, const FrameScheduler &scheduler,
+                    const SDL_FRect &area);
+
+}  // namespace player
@@ -0,0 +1,235 @@
+#include "glyph_atlas.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include <fontconfig/fontconfig.h>
+#include <SDL3/SDL.h>
+#include <spdlog/spdlog.h>
+
+namespace player {
+namespace {
+
+constexpr int kAtlasSize = 1024;
+
+// keeps linear filtering from bleeding neighbouring glyphs into each other
+constexpr int kPadding = 1;
+
+constexpr char32_t kReplacementCharacter = 0xFFFD;
+
+// asked from fontconfig when the font file doesn't exist
+constexpr const char *kFallbackFont = "DejaVu Sans";
+
+using FcPatternPtr = std::unique_ptr<FcPattern, decltype(&FcPatternDestroy)>;
+
+// `path` if it exists, else the file fontconfig matches for the fallback font
+// (font paths differ between distributions), empty if there is none.
+std::string FindFont(const std::string &path) {
+  if (std::filesystem::exists(path)) {
+    return path;
+  }
+  if (!FcInit()) {
+    spdlog::error("Error initializing fontconfig");
+    return {};
+  }
+
+  auto pattern = FcPatternPtr{
+      FcNameParse(reinterpret_cast<const FcChar8 *>(kFallbackFont)),
+      &FcPatternDestroy};
+  if (!pattern) {
+    return {};
+  }
+  FcConfigSubstitute(nullptr, pattern.get(), FcMatchPattern);
+  FcDefaultSubstitute(pattern.get());
+
+  FcResult result;
+  auto match = FcPatternPtr{FcFontMatch(nullptr, pattern.get(), &result),
+                            &FcPatternDestroy};
+  FcChar8 *file = nullptr;
+  if (!match ||
+      FcPatternGetString(match.get(), FC_FILE, 0, &file) != FcResultMatch) {
+    return {};
+  }
+  spdlog::warn("Font {} not found, using {}", path,
+               reinterpret_cast<const char *>(file));
+  return reinterpret_cast<const char *>(file);
+}
+
+}  // namespace
+
+std::optional<GlyphAtlas> GlyphAtlas::Create(SDL_Renderer *renderer,
+                                             const std::string &requested_font,
+                                             int pixel_size) {
+  auto font_path = FindFont(requested_font);
+  if (font_path.empty()) {
+    spdlog::error("No font for subtitles: {}", requested_font);
+    return {};
+  }
+
+  FT_Library library_raw;
+  if (FT_Init_FreeType(&library_raw) != 0) {
+    spdlog::error("Error initializing FreeType");
+    return {};
+  }
+  auto library = FTLibraryPtr{library_raw, &FT_Done_FreeType};
+
+  FT_Face face_raw;
+  if (FT_New_Face(library.get(), font_path.c_str(), 0, &face_raw) != 0) {
+    spdlog::error("Error loading font: {}", font_path);
+    return {};
+  }
+  auto face = FTFacePtr{face_raw, &FT_Done_Face};
+
+  if (FT_Set_Pixel_Sizes(face.get(), 0, pixel_size) != 0) {
+    spdlog::error("Font {} has no size {}", font_path, pixel_size);
+    return {};
+  }
+
+  auto texture = SDLTexturePtr{
+      SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA32,
+                        SDL_TEXTUREACCESS_STATIC, kAtlasSize, kAtlasSize),
+      &SDL_DestroyTexture};
+  if (texture.get() == nullptr) {
+    spdlog::error("Error creating glyph atlas! {}", SDL_GetError());
+    return {};
+  }
+
+  SDL_SetTextureBlendMode(texture.get(), SDL_BLENDMODE_BLEND);
+
+  auto atlas =
+      GlyphAtlas{std::move(library), std::move(face), std::move(texture)};
+  atlas.Clear();
+  return atlas;
+}
+
+GlyphAtlas::GlyphAtlas(FTLibraryPtr library, FTFacePtr face,
+                       SDLTexturePtr texture)
+    : library(std::move(library)),
+      face(std::move(face)),
+      texture(std::move(texture)) {
+  const auto &metrics = this->face->size->metrics;
+  line_height = metrics.height / 64.f;
+  ascender = metrics.ascender / 64.f;
+}
+
+const Glyph *GlyphAtlas::Get(char32_t codepoint) {
+  if (auto it = glyphs.find(codepoint); it != glyphs.end()) {
+    return it->second ? &*it->second : nullptr;
+  }
+  return Rasterize(codepoint);
+}
+
+void GlyphAtlas::Clear() {
+  auto transparent = std::vector<Uint8>(kAtlasSize * kAtlasSize * 4, 0);
+  SDL_UpdateTexture(texture.get(), nullptr, transparent.data(),
+                    kAtlasSize * 4);
+  glyphs.clear();
+  shelf_x = 0;
+  shelf_y = 0;
+  shelf_height = 0;
+  generation++;
+}
+
+const Glyph *GlyphAtlas::Rasterize(char32_t codepoint) {
+  if (FT_Load_Char(face.get(), codepoint, FT_LOAD_RENDER) != 0) {
+    spdlog::warn("Missing glyph U+{:04X}", static_cast<uint32_t>(codepoint));
+    // cached as missing, retrying would only fail again
+    glyphs[codepoint];
+    return nullptr;
+  }
+
+  const FT_GlyphSlot slot = face->glyph;
+  const FT_Bitmap &bitmap = slot->bitmap;
+  int width = static_cast<int>(bitmap.width);
+  int height = static_cast<int>(bitmap.rows);
+
+  auto glyph = Glyph{{0.f, 0.f, 0.f, 0.f},
+                     {0.f, 0.f, 0.f, 0.f},
+                     static_cast<float>(slot->bitmap_left),
+                     static_cast<float>(slot->bitmap_top),
+                     slot->advance.x / 64.f};
+
+  if (width > 0 && height > 0) {
+    if (shelf_x + width + kPadding > kAtlasSize) {
+      shelf_x = 0;
+      shelf_y += shelf_height;
+      shelf_height = 0;
+    }
+    if (width + kPadding > kAtlasSize || height + kPadding > kAtlasSize) {
+      spdlog::warn("Glyph U+{:04X} is larger than the atlas",
+                   static_cast<uint32_t>(codepoint));
+      glyphs[codepoint];
+      return nullptr;
+    }
+    if (shelf_y + height + kPadding > kAtlasSize) {
+      // long CJK tracks use more glyphs than fit, start over with the ones
+      // the current text needs
+      spdlog::info("Glyph atlas full after {} glyphs, clearing it",
+                   glyphs.size());
+      Clear();
+    }
+
+    // white glyph, coverage goes to alpha
+    std::vector<Uint8> pixels(width * height * 4, 255);
+    for (int y = 0; y < height; y++) {
+      for (int x = 0; x < width; x++) {
+        pixels[(y * width + x) * 4 + 3] = bitmap.buffer[y * bitmap.pitch + x];
+      }
+    }
+
+    auto dst = SDL_Rect{shelf_x, shelf_y, width, height};
+    SDL_UpdateTexture(texture.get(), &dst, pixels.data(), width * 4);
+
+    glyph.rect = SDL_FRect{static_cast<float>(shelf_x),
+                           static_cast<float>(shelf_y),
+                           static_cast<float>(width),
+                           static_cast<float>(height)};
+    glyph.uv = SDL_FRect{glyph.rect.x / kAtlasSize, glyph.rect.y / kAtlasSize,
+                         glyph.rect.w / kAtlasSize, glyph.rect.h / kAtlasSize};
+
+    shelf_x += width + kPadding;
+    shelf_height = std::max(shelf_height, height + kPadding);
+  }
+
+  auto &entry = glyphs[codepoint];
+  entry = glyph;
+  return &*entry;
+}
+
+char32_t NextCodepoint(const std::string &text, size_t &pos) {
+  auto byte = [&](size_t i) { return static_cast<unsigned char>(text[i]); };
+
+  unsigned char lead = byte(pos++);
+  if (lead < 0x80) {
+    return lead;
+  }
+
+  int length = 0;
+  char32_t codepoint = 0;
+  if ((lead & 0xE0) == 0xC0) {
+    length = 1;
+    codepoint = lead & 0x1F;
+  } else if ((lead & 0xF0) == 0xE0) {
+    length = 2;
+    codepoint = lead & 0x0F;
+  } else if ((lead & 0xF8) == 0xF0) {
+    length = 3;
+    codepoint = lead & 0x07;
+  } else {
+    return kReplacementCharacter;
+  }
+
+  for (int i = 0; i < length; i++) {
+    if (pos >= text.size() || (byte(pos) & 0xC0) != 0x80) {
+      return kReplacementCharacter;
+    }
+    codepoint = (codepoint << 6) | (byte(pos++) & 0x3F);
+  }
+  return codepoint;
+}
+
+}  // namespace player
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+
+#include <ft2build.h>
+#include FT_FREETYPE_H
+#include <SDL3/SDL.h>
+
+#include "sdl_utils.h"
+
+namespace player {
+
+using FTLibraryPtr =
+    std::unique_ptr<std::remove_pointer_t<FT_Library>,
+                    decltype(&FT_Done_FreeType)>;
+using FTFacePtr =
+    std::unique_ptr<std::remove_pointer_t<FT_Face>, decltype(&FT_Done_Face)>;
+
+struct Glyph {
+  // position in the atlas texture in pixels and normalized, empty for
+  // whitespace
+  SDL_FRect rect;
+  SDL_FRect uv;
+  float bearing_x;
+  float bearing_y;
+  float advance;
+};
+
+// Glyphs are rasterized on first use into a single texture and reused for
+// every following string, drawing text is a batch of textured quads. When
+// the texture is full it's cleared and filled again with the glyphs in use,
+// which invalidates every glyph handed out before; Generation() tells.
+class GlyphAtlas {
+ public:
+  // A missing `font_path` is replaced by a fallback font from fontconfig.
+  static std::optional<GlyphAtlas> Create(SDL_Renderer *renderer,
+                                          const std::string &font_path,
+                                          int pixel_size);
+
+  // Returns nullptr if the glyph is missing or larger than the atlas.
+  const Glyph *Get(char32_t codepoint);
+  // changes whenever the atlas was cleared
+  uint64_t Generation() const { return generation; }
+
+  SDL_Texture *Texture() const { return texture.get(); }
+  float LineHeight() const { return line_height; }
+  float Ascender() const { return ascender; }
+  size_t Size() const { return glyphs.size(); }
+
+ private:
+  GlyphAtlas(FTLibraryPtr library, FTFacePtr face, SDLTexturePtr texture);
+
+  const Glyph *Rasterize(char32_t codepoint);
+  void Clear();
+
+  FTLibraryPtr library;
+  FTFacePtr face;
+  SDLTexturePtr texture;
+
+  float line_height;
+  float ascender;
+
+  // shelf packing state
+  int shelf_x = 0;
+  int shelf_y = 0;
+  int shelf_height = 0;
+  uint64_t generation = 0;
+
+  std::unordered_map<char32_t, std::optional<Glyph>> glyphs;
+};
+
+// Decodes the next code point and advances `pos`, invalid sequences decode to
+// U+FFFD.
+char32_t NextCodepoint(const std::string &text, size_t &pos);
+
+}  // namespace player
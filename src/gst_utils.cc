@@ -74,7 +74,7 @@ LinkResult LinkAll(
 
   for (const auto &elements : elements_to_link) {
     for (int i = 1; i < elements.size(); i++) {
-      success |=
+      success &=
           LinkElements(elements[i - 1], elements[i]) == LinkResult::SUCCESS;
     }
   }
@@ -91,6 +91,19 @@ void PrintErrorMessage(GstMessage *msg) {
   }
 }
 
+void PrintWarningMessage(GstMessage *msg) {
+  GError *err;
+  gchar *debug_info;
+  gst_message_parse_warning(msg, &err, &debug_info);
+  auto error = GlibErrorPtr{err, &g_error_free};
+  auto debug = GlibCharPtr{debug_info, {}};
+
+  spdlog::warn("[warning] {}: {}", GetObjectName(msg->src), error->message);
+  if (debug) {
+    spdlog::warn("[debug info] {}", debug.get());
+  }
+}
+
 void PrintStateChangedMessage(GstMessage *msg) {
   GstState old_state, new_state;
   gst_message_parse_state_changed(msg, &old_state, &new_state, NULL);
@@ -22,15 +22,21 @@ using GstElementPtr = std::unique_ptr<GstElement, GstDeleter<GstElement>>;
 using GstBusPtr = std::unique_ptr<GstBus, GstDeleter<GstBus>>;
 using GstPadPtr = std::unique_ptr<GstPad, GstDeleter<GstPad>>;
 using GstObjectPtr = std::unique_ptr<GstObject, GstDeleter<GstObject>>;
+using GstClockPtr = std::unique_ptr<GstClock, GstDeleter<GstClock>>;
 
 using GlibCharPtr = std::unique_ptr<gchar, GlibDeleter<gchar>>;
 using GlibErrorPtr = std::unique_ptr<GError, decltype(&g_error_free)>;
 
 using GstCapsPtr = std::unique_ptr<GstCaps, decltype(&gst_caps_unref)>;
 using GstMessagePtr = std::unique_ptr<GstMessage, decltype(&gst_message_unref)>;
+using GstSamplePtr = std::unique_ptr<GstSample, decltype(&gst_sample_unref)>;
+using GstBufferPtr = std::unique_ptr<GstBuffer, decltype(&gst_buffer_unref)>;
+using GBytesPtr = std::unique_ptr<GBytes, decltype(&g_bytes_unref)>;
 using GstContextPtr = std::unique_ptr<GstContext, decltype(&gst_context_unref)>;
 using GstTagListPtr =
     std::unique_ptr<GstTagList, decltype(&gst_tag_list_unref)>;
+using GstStructurePtr =
+    std::unique_ptr<GstStructure, decltype(&gst_structure_free)>;
 
 enum class LinkResult { SUCCESS, ERROR };
 
@@ -62,6 +68,8 @@ std::string GetParentName(TGstType *elem) {
 
 void PrintErrorMessage(GstMessage *msg);
 
+void PrintWarningMessage(GstMessage *msg);
+
 void PrintStateChangedMessage(GstMessage *msg);
 
 void PrintStreamStatusMessage(GstMessage *msg);
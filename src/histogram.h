@@ -0,0 +1,70 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <spdlog/fmt/fmt.h>
+
+namespace player::utils {
+
+// Fixed-width bucket histogram, cheap enough to update on every frame. Values
+// past the last bucket are accumulated in it, the exact maximum is kept
+// separately.
+class Histogram {
+ public:
+  Histogram(double bucket_width, size_t buckets)
+      : bucket_width(bucket_width), counts(buckets, 0) {}
+
+  void Add(double value) {
+    size_t bucket = value > 0 ? static_cast<size_t>(value / bucket_width) : 0;
+    counts[std::min(bucket, counts.size() - 1)]++;
+    count++;
+    sum += value;
+    max = std::max(max, value);
+  }
+
+  void Reset() {
+    std::fill(counts.begin(), counts.end(), 0);
+    count = 0;
+    sum = 0;
+    max = 0;
+  }
+
+  // Upper bound of the bucket containing the p-th percentile, p in [0, 1].
+  double Percentile(double p) const {
+    auto target = static_cast<uint64_t>(std::ceil(p * count));
+    uint64_t seen = 0;
+    for (size_t i = 0; i + 1 < counts.size(); i++) {
+      seen += counts[i];
+      if (seen >= target && seen > 0) {
+        return std::min((i + 1) * bucket_width, max);
+      }
+    }
+    return max;
+  }
+
+  double Mean() const { return count > 0 ? sum / count : 0; }
+  double Max() const { return max; }
+  uint64_t Count() const { return count; }
+  double BucketWidth() const { return bucket_width; }
+  const std::vector<uint64_t> &Buckets() const { return counts; }
+
+  std::string Summary() const {
+    return fmt::format("n={} mean={:.2f} p50={:.2f} p95={:.2f} p99={:.2f} "
+                       "max={:.2f}",
+                       count, Mean(), Percentile(0.5), Percentile(0.95),
+                       Percentile(0.99), max);
+  }
+
+ private:
+  double bucket_width;
+  std::vector<uint64_t> counts;
+  uint64_t count = 0;
+  double sum = 0;
+  double max = 0;
+};
+
+}  // namespace player::utils
@@ -0,0 +1,138 @@
+#include "latency_probe.h"
+
+#include <gst/gst.h>
+#include <spdlog/spdlog.h>
+
+#include "tracing.h"
+
+namespace player {
+namespace {
+
+constexpr const char *kStampCaps = "timestamp/x-player-ingress";
+constexpr GstClockTime kLogInterval = 5 * GST_SECOND;
+
+// 1 ms buckets up to 500 ms
+constexpr double kBucketMs = 1.0;
+constexpr size_t kBuckets = 500;
+
+double ToMs(GstClockTimeDiff time) { return static_cast<double>(time) / 1e6; }
+
+}  // namespace
+
+LatencyProbe::LatencyProbe(GstElement *pipeline, GstPad *source, GstPad *sink)
+    : pipeline(pipeline),
+      source(GstPadPtr{GST_PAD(gst_object_ref(source))}),
+      sink(GstPadPtr{GST_PAD(gst_object_ref(sink))}),
+      stamp_caps(GstCapsPtr{gst_caps_from_string(kStampCaps),
+                            &gst_caps_unref}),
+      capture(kBucketMs, kBuckets),
+      end_to_end(kBucketMs, kBuckets),
+      end_to_end_total(kBucketMs, kBuckets) {
+  source_probe = gst_pad_add_probe(source, GST_PAD_PROBE_TYPE_BUFFER, Stamp,
+                                   this, nullptr);
+  sink_probe = gst_pad_add_probe(sink, GST_PAD_PROBE_TYPE_BUFFER, Measure,
+                                 this, nullptr);
+}
+
+LatencyProbe::~LatencyProbe() {
+  gst_pad_remove_probe(source.get(), source_probe);
+  gst_pad_remove_probe(sink.get(), sink_probe);
+  LogSummary();
+}
+
+void LatencyProbe::LogSummary() const {
+  spdlog::info("[latency] source to sink ms: {}, unstamped {}",
+               end_to_end_total.Summary(), unstamped);
+  spdlog::info("[latency] capture to source ms: {}", capture.Summary());
+}
+
+GstClockTime LatencyProbe::Now() {
+  auto clock = GstClockPtr{gst_element_get_clock(pipeline)};
+  if (!clock) {
+    return GST_CLOCK_TIME_NONE;
+  }
+  return gst_clock_get_time(clock.get()) - gst_element_get_base_time(pipeline);
+}
+
+GstClockTime LatencyProbe::BufferRunningTime(GstPad *pad, GstBuffer *buffer) {
+  if (!GST_BUFFER_PTS_IS_VALID(buffer)) {
+    return GST_CLOCK_TIME_NONE;
+  }
+
+  auto event = gst_pad_get_sticky_event(pad, GST_EVENT_SEGMENT, 0);
+  if (!event) {
+    return GST_CLOCK_TIME_NONE;
+  }
+
+  const GstSegment *segment;
+  gst_event_parse_segment(event, &segment);
+  auto running_time = gst_segment_to_running_time(segment, GST_FORMAT_TIME,
+                                                  GST_BUFFER_PTS(buffer));
+  gst_event_unref(event);
+  return running_time;
+}
+
+GstPadProbeReturn LatencyProbe::Stamp(GstPad *pad, GstPadProbeInfo *info,
+                                      gpointer user_data) {
+  auto *probe = static_cast<LatencyProbe *>(user_data);
+
+  auto now = probe->Now();
+  if (!GST_CLOCK_TIME_IS_VALID(now)) {
+    return GST_PAD_PROBE_OK;
+  }
+
+  auto *buffer = gst_buffer_make_writable(GST_PAD_PROBE_INFO_BUFFER(info));
+  GST_PAD_PROBE_INFO_DATA(info) = buffer;
+  gst_buffer_add_reference_timestamp_meta(buffer, probe->stamp_caps.get(), now,
+                                          GST_CLOCK_TIME_NONE);
+
+  // live sources timestamp buffers with the capture (or arrival) time
+  auto captured = BufferRunningTime(pad, buffer);
+  if (GST_CLOCK_TIME_IS_VALID(captured) && now >= captured) {
+    probe->capture.Add(ToMs(GST_CLOCK_DIFF(captured, now)));
+  }
+
+  return GST_PAD_PROBE_OK;
+}
+
+GstPadProbeReturn LatencyProbe::Measure(GstPad *pad, GstPadProbeInfo *info,
+                                        gpointer user_data) {
+  auto *probe = static_cast<LatencyProbe *>(user_data);
+  auto *buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+
+  auto now = probe->Now();
+  if (!GST_CLOCK_TIME_IS_VALID(now)) {
+    return GST_PAD_PROBE_OK;
+  }
+
+  GstClockTime ingress = GST_CLOCK_TIME_NONE;
+  if (auto *meta = gst_buffer_get_reference_timestamp_meta(
+          buffer, probe->stamp_caps.get())) {
+    ingress = meta->timestamp;
+  } else {
+    probe->unstamped++;
+    ingress = BufferRunningTime(pad, buffer);
+  }
+
+  if (!GST_CLOCK_TIME_IS_VALID(ingress)) {
+    return GST_PAD_PROBE_OK;
+  }
+
+  auto latency = ToMs(GST_CLOCK_DIFF(ingress, now));
+  probe->end_to_end.Add(latency);
+  probe->end_to_end_total.Add(latency);
+  tracing::Counter("source to sink ms", latency);
+
+  if (!GST_CLOCK_TIME_IS_VALID(probe->last_log)) {
+    probe->last_log = now;
+  } else if (now - probe->last_log >= kLogInterval) {
+    spdlog::info("[latency] source to sink ms: {}",
+                 probe->end_to_end.Summary());
+    probe->end_to_end.Reset();
+    probe->last_log = now;
+  }
+
+  return GST_PAD_PROBE_OK;
+}
+
+}  // namespace player
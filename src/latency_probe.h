@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstdint>
+
+#include <gst/gst.h>
+
+#include "gst_utils.h"
+#include "histogram.h"
+
+namespace player {
+
+// Stamps every buffer leaving the source with its ingress running time and
+// measures how old it is when it reaches the sink. Buffers which lose the
+// stamp on the way (e.g. aggregated by a depayloader) are measured from
+// their PTS, which live sources set to the capture time.
+class LatencyProbe {
+ public:
+  LatencyProbe(GstElement *pipeline, GstPad *source, GstPad *sink);
+  ~LatencyProbe();
+
+  LatencyProbe(const LatencyProbe &other) = delete;
+  LatencyProbe &operator=(const LatencyProbe &) = delete;
+
+  void LogSummary() const;
+
+ private:
+  static GstPadProbeReturn Stamp(GstPad *pad, GstPadProbeInfo *info,
+                                 gpointer user_data);
+  static GstPadProbeReturn Measure(GstPad *pad, GstPadProbeInfo *info,
+                                   gpointer user_data);
+
+  GstClockTime Now();
+  static GstClockTime BufferRunningTime(GstPad *pad, GstBuffer *buffer);
+
+  GstElement *pipeline;
+  GstPadPtr source;
+  GstPadPtr sink;
+  gulong source_probe;
+  gulong sink_probe;
+
+  GstCapsPtr stamp_caps;
+
+  // written by the source streaming thread only
+  utils::Histogram capture;
+
+  // written by the sink streaming thread only
+  utils::Histogram end_to_end;
+  utils::Histogram end_to_end_total;
+  uint64_t unstamped = 0;
+  GstClockTime last_log = GST_CLOCK_TIME_NONE;
+};
+
+}  // namespace player
@@ -0,0 +1,502 @@
+#include "media_index.h"
+
+#include <algorithm>
+#include <iterator>
+#include <memory>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <gst/gst.h>
+#include <spdlog/fmt/fmt.h>
+#include <spdlog/spdlog.h>
+
+namespace player {
+namespace {
+
+using GKeyFilePtr = std::unique_ptr<GKeyFile, decltype(&g_key_file_unref)>;
+
+constexpr const char *kFileGroup = "file";
+constexpr const char *kMediaGroup = "media";
+
+// 1 ms buckets up to 5 s
+constexpr double kBucketMs = 1.0;
+constexpr size_t kBuckets = 5000;
+
+GstClockTime Now() { return gst_util_get_timestamp(); }
+
+double ToMs(GstClockTime time) { return static_cast<double>(time) / 1e6; }
+
+struct FileKey {
+  std::string path;
+  guint64 size;
+  guint64 mtime_ns;
+};
+
+std::optional<FileKey> StatFile(const std::string &path) {
+  auto canonical = GlibCharPtr{g_canonicalize_filename(path.c_str(), nullptr)};
+  GStatBuf stat;
+  if (g_stat(canonical.get(), &stat) != 0) {
+    return {};
+  }
+  return FileKey{canonical.get(), static_cast<guint64>(stat.st_size),
+                 static_cast<guint64>(stat.st_mtim.tv_sec) * 1000000000 +
+                     stat.st_mtim.tv_nsec};
+}
+
+std::string IndexPath(const std::string &dir, const FileKey &key) {
+  auto hash = GlibCharPtr{
+      g_compute_checksum_for_string(G_CHECKSUM_SHA1, key.path.c_str(), -1)};
+  return fmt::format("{}/{}.index", dir, hash.get());
+}
+
+// parsed streams are only looked at, nothing is decoded
+void LinkToFakesink(GstElement *element, GstPad *pad, gpointer user_data) {
+  auto *sink = gst_element_factory_make("fakesink", nullptr);
+  g_object_set(sink, "sync", FALSE, NULL);
+  gst_bin_add(GST_BIN(user_data), sink);
+  gst_element_sync_state_with_parent(sink);
+  auto sink_pad = GstPadPtr{gst_element_get_static_pad(sink, "sink")};
+  if (LinkPads(pad, sink_pad.get()) != LinkResult::SUCCESS) {
+    spdlog::error("[index] couldn't link {}", GetObjectName(pad));
+  }
+}
+
+}  // namespace
+
+std::string DefaultIndexDir() {
+  return fmt::format("{}/player/index", g_get_user_cache_dir());
+}
+
+std::optional<MediaIndex> LoadIndex(const std::string &dir,
+                                    const std::string &path) {
+  auto key = StatFile(path);
+  if (!key) {
+    return {};
+  }
+
+  auto file = GKeyFilePtr{g_key_file_new(), &g_key_file_unref};
+  if (!g_key_file_load_from_file(file.get(), IndexPath(dir, *key).c_str(),
+                                 G_KEY_FILE_NONE, nullptr)) {
+    return {};
+  }
+
+  auto *f = file.get();
+  auto indexed_path =
+      GlibCharPtr{g_key_file_get_string(f, kFileGroup, "path", nullptr)};
+  if (!indexed_path || key->path != indexed_path.get() ||
+      g_key_file_get_uint64(f, kFileGroup, "size", nullptr) != key->size ||
+      g_key_file_get_uint64(f, kFileGroup, "mtime", nullptr) !=
+          key->mtime_ns) {
+    spdlog::info("[index] {} changed since it was indexed", path);
+    return {};
+  }
+
+  MediaIndex index;
+  if (auto value = GlibCharPtr{
+          g_key_file_get_string(f, kMediaGroup, "container", nullptr)}) {
+    index.container = value.get();
+  }
+  if (auto value =
+          GlibCharPtr{g_key_file_get_string(f, kMediaGroup, "tags", nullptr)}) {
+    index.tags = value.get();
+  }
+  if (g_key_file_has_key(f, kMediaGroup, "duration", nullptr)) {
+    index.duration = g_key_file_get_uint64(f, kMediaGroup, "duration", nullptr);
+  }
+  index.complete = g_key_file_get_boolean(f, kMediaGroup, "complete", nullptr);
+
+  gsize length = 0;
+  if (auto **streams = g_key_file_get_string_list(f, kMediaGroup, "streams",
+                                                  &length, nullptr)) {
+    for (gsize i = 0; i < length; i++) {
+      index.streams.emplace_back(streams[i]);
+    }
+    g_strfreev(streams);
+  }
+
+  // older indexes store time:offset pairs, the offset is ignored
+  if (auto **keyframes = g_key_file_get_string_list(
+          f, kMediaGroup, "keyframes", &length, nullptr)) {
+    for (gsize i = 0; i < length; i++) {
+      index.keyframes.insert(g_ascii_strtoull(keyframes[i], nullptr, 10));
+    }
+    g_strfreev(keyframes);
+  }
+
+  return index;
+}
+
+bool SaveIndex(const std::string &dir, const std::string &path,
+               const MediaIndex &index) {
+  auto key = StatFile(path);
+  if (!key) {
+    return false;
+  }
+
+  auto file = GKeyFilePtr{g_key_file_new(), &g_key_file_unref};
+  auto *f = file.get();
+  g_key_file_set_string(f, kFileGroup, "path", key->path.c_str());
+  g_key_file_set_uint64(f, kFileGroup, "size", key->size);
+  g_key_file_set_uint64(f, kFileGroup, "mtime", key->mtime_ns);
+
+  g_key_file_set_string(f, kMediaGroup, "container", index.container.c_str());
+  g_key_file_set_string(f, kMediaGroup, "tags", index.tags.c_str());
+  if (GST_CLOCK_TIME_IS_VALID(index.duration)) {
+    g_key_file_set_uint64(f, kMediaGroup, "duration", index.duration);
+  }
+  g_key_file_set_boolean(f, kMediaGroup, "complete", index.complete);
+
+  std::vector<const gchar *> streams;
+  for (const auto &stream : index.streams) {
+    streams.push_back(stream.c_str());
+  }
+  g_key_file_set_string_list(f, kMediaGroup, "streams", streams.data(),
+                             streams.size());
+
+  std::vector<std::string> keyframes;
+  std::vector<const gchar *> keyframe_ptrs;
+  for (auto time : index.keyframes) {
+    keyframes.push_back(fmt::format("{}", time));
+  }
+  for (const auto &keyframe : keyframes) {
+    keyframe_ptrs.push_back(keyframe.c_str());
+  }
+  g_key_file_set_string_list(f, kMediaGroup, "keyframes",
+                             keyframe_ptrs.data(), keyframe_ptrs.size());
+
+  g_mkdir_with_parents(dir.c_str(), 0755);
+  GError *error = nullptr;
+  // written to a temporary file and renamed
+  if (!g_key_file_save_to_file(f, IndexPath(dir, *key).c_str(), &error)) {
+    auto err = GlibErrorPtr{error, &g_error_free};
+    spdlog::error("[index] couldn't save the index of {}: {}", path,
+                  err->message);
+    return false;
+  }
+  return true;
+}
+
+MediaIndexer::MediaIndexer(std::string dir, std::string path)
+    : dir(std::move(dir)),
+      path(std::move(path)),
+      snapped_seek_ms(kBucketMs, kBuckets),
+      key_unit_seek_ms(kBucketMs, kBuckets) {
+  gst_segment_init(&segment, GST_FORMAT_TIME);
+  if (this->dir.empty()) {
+    spdlog::info("[index] disabled");
+  } else if (auto loaded = LoadIndex(this->dir, this->path)) {
+    index = std::move(*loaded);
+    hit = true;
+    spdlog::info("[index] {}: {}, {} streams, {} keyframes{}", this->path,
+                 index.container, index.streams.size(), index.keyframes.size(),
+                 index.complete ? "" : " (partial)");
+    if (!index.tags.empty()) {
+      spdlog::info("[index] tags: {}", index.tags);
+      tags = GstTagListPtr{gst_tag_list_new_from_string(index.tags.c_str()),
+                           &gst_tag_list_unref};
+    }
+  } else {
+    spdlog::info("[index] {} isn't indexed yet", this->path);
+  }
+}
+
+MediaIndexer::~MediaIndexer() {
+  if (probe) {
+    gst_pad_remove_probe(video_pad.get(), probe);
+  }
+  LogSummary();
+
+  std::lock_guard lock{mutex};
+  if (changed && tags) {
+    auto str = GlibCharPtr{gst_tag_list_to_string(tags.get())};
+    index.tags = str.get();
+  }
+  if (changed && !dir.empty() && SaveIndex(dir, path, index)) {
+    spdlog::info("[index] saved {} keyframes of {}{}", index.keyframes.size(),
+                 path, index.complete ? "" : " (partial)");
+  }
+}
+
+void MediaIndexer::Attach(GstElement *pipeline, GstElement *typefind,
+                          GstElement *parse) {
+  this->pipeline = pipeline;
+
+  std::lock_guard lock{mutex};
+  if (!index.container.empty()) {
+    // typefind passes the caps on without reading a byte
+    auto caps = GstCapsPtr{gst_caps_from_string(index.container.c_str()),
+                           &gst_caps_unref};
+    if (caps) {
+      g_object_set(typefind, "force-caps", caps.get(), NULL);
+    }
+  }
+  g_signal_connect(typefind, "have-type", G_CALLBACK(HaveType), this);
+  g_signal_connect(parse, "pad-added", G_CALLBACK(PadAdded), this);
+}
+
+bool MediaIndexer::Complete() {
+  std::lock_guard lock{mutex};
+  return index.complete;
+}
+
+void MediaIndexer::HaveType(GstElement *typefind, guint probability,
+                            GstCaps *caps, gpointer user_data) {
+  auto *indexer = static_cast<MediaIndexer *>(user_data);
+  auto str = GlibCharPtr{gst_caps_to_string(caps)};
+
+  std::lock_guard lock{indexer->mutex};
+  if (indexer->index.container != str.get()) {
+    indexer->index.container = str.get();
+    indexer->changed = true;
+  }
+}
+
+void MediaIndexer::PadAdded(GstElement *element, GstPad *pad,
+                            gpointer user_data) {
+  auto *indexer = static_cast<MediaIndexer *>(user_data);
+  auto caps = GstCapsPtr{gst_pad_get_current_caps(pad), &gst_caps_unref};
+  if (!caps) {
+    return;
+  }
+  auto str = GlibCharPtr{gst_caps_to_string(caps.get())};
+
+  {
+    std::lock_guard lock{indexer->mutex};
+    auto &streams = indexer->index.streams;
+    if (std::find(streams.begin(), streams.end(), str.get()) ==
+        streams.end()) {
+      streams.emplace_back(str.get());
+      indexer->changed = true;
+    }
+  }
+
+  auto *media_type =
+      gst_structure_get_name(gst_caps_get_structure(caps.get(), 0));
+  if (g_str_has_prefix(media_type, "video") && !indexer->video_pad) {
+    indexer->video_pad = GstPadPtr{GST_PAD(gst_object_ref(pad))};
+    indexer->probe = gst_pad_add_probe(
+        pad,
+        static_cast<GstPadProbeType>(GST_PAD_PROBE_TYPE_BUFFER |
+                                     GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM),
+        RecordKeyframe, indexer, nullptr);
+  }
+}
+
+GstPadProbeReturn MediaIndexer::RecordKeyframe(GstPad *pad,
+                                               GstPadProbeInfo *info,
+                                               gpointer user_data) {
+  auto *indexer = static_cast<MediaIndexer *>(user_data);
+
+  if (GST_PAD_PROBE_INFO_TYPE(info) & GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM) {
+    auto *event = GST_PAD_PROBE_INFO_EVENT(info);
+    if (GST_EVENT_TYPE(event) == GST_EVENT_SEGMENT) {
+      const GstSegment *segment;
+      gst_event_parse_segment(event, &segment);
+      gst_segment_copy_into(segment, &indexer->segment);
+      if (!GST_CLOCK_TIME_IS_VALID(indexer->file_start)) {
+        indexer->file_start = segment->start;
+      }
+      std::lock_guard lock{indexer->mutex};
+      indexer->contiguous = segment->start <= indexer->file_start;
+    }
+    return GST_PAD_PROBE_OK;
+  }
+
+  auto *buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+  if (GST_BUFFER_FLAG_IS_SET(buffer, GST_BUFFER_FLAG_DELTA_UNIT)) {
+    return GST_PAD_PROBE_OK;
+  }
+  auto timestamp = GST_BUFFER_PTS_IS_VALID(buffer) ? GST_BUFFER_PTS(buffer)
+                                                   : GST_BUFFER_DTS(buffer);
+  auto time = gst_segment_to_stream_time(&indexer->segment, GST_FORMAT_TIME,
+                                         timestamp);
+  if (!GST_CLOCK_TIME_IS_VALID(time)) {
+    return GST_PAD_PROBE_OK;
+  }
+
+  std::lock_guard lock{indexer->mutex};
+  if (indexer->index.keyframes.insert(time).second) {
+    indexer->changed = true;
+  }
+  return GST_PAD_PROBE_OK;
+}
+
+bool MediaIndexer::OnTag(GstMessage *msg) {
+  GstTagList *posted = nullptr;
+  gst_message_parse_tag(msg, &posted);
+  auto tag_list = GstTagListPtr{posted, &gst_tag_list_unref};
+
+  std::lock_guard lock{mutex};
+  // every element posts its own list and parsers repost the bitrate as it
+  // changes, the latest value of a tag replaces the earlier one
+  auto merged = GstTagListPtr{
+      gst_tag_list_merge(tags.get(), tag_list.get(), GST_TAG_MERGE_REPLACE),
+      &gst_tag_list_unref};
+  if (tags && merged && gst_tag_list_is_equal(tags.get(), merged.get())) {
+    return false;
+  }
+  tags = std::move(merged);
+  changed = true;
+  return true;
+}
+
+void MediaIndexer::OnOpen() {
+  if (!GST_CLOCK_TIME_IS_VALID(open_start) && open_ms < 0.0) {
+    open_start = Now();
+  }
+}
+
+void MediaIndexer::OnAsyncDone() {
+  auto now = Now();
+  if (GST_CLOCK_TIME_IS_VALID(open_start)) {
+    open_ms = ToMs(now - open_start);
+    open_start = GST_CLOCK_TIME_NONE;
+    spdlog::info("[index] opened in {:.1f} ms ({})", open_ms,
+                 hit ? "indexed" : "not indexed");
+  }
+  if (GST_CLOCK_TIME_IS_VALID(seek_start)) {
+    auto elapsed = ToMs(now - seek_start);
+    (seek_snapped ? snapped_seek_ms : key_unit_seek_ms).Add(elapsed);
+    seek_start = GST_CLOCK_TIME_NONE;
+    spdlog::info("[index] seek took {:.1f} ms ({})", elapsed,
+                 seek_snapped ? "indexed keyframe" : "key unit");
+  }
+
+  gint64 duration;
+  if (pipeline &&
+      gst_element_query_duration(pipeline, GST_FORMAT_TIME, &duration)) {
+    std::lock_guard lock{mutex};
+    if (index.duration != static_cast<GstClockTime>(duration)) {
+      index.duration = duration;
+      changed = true;
+    }
+  }
+}
+
+void MediaIndexer::OnEos() {
+  std::lock_guard lock{mutex};
+  // skipped parts of the file are missing keyframes
+  if (contiguous && !index.complete) {
+    index.complete = true;
+    changed = true;
+  }
+}
+
+bool MediaIndexer::Seek(GstClockTime target, double rate, bool segment) {
+  GstClockTime position = target;
+  auto flags = GST_SEEK_FLAG_FLUSH | (segment ? GST_SEEK_FLAG_SEGMENT : 0);
+  {
+    std::lock_guard lock{mutex};
+    auto after = index.keyframes.upper_bound(target);
+    seek_snapped = index.complete && after != index.keyframes.begin();
+    if (seek_snapped) {
+      // lands on the keyframe itself, nothing is decoded and thrown away
+      position = *std::prev(after);
+      flags |= GST_SEEK_FLAG_ACCURATE;
+    } else {
+      flags |= GST_SEEK_FLAG_KEY_UNIT | GST_SEEK_FLAG_SNAP_BEFORE;
+    }
+  }
+
+  seek_start = Now();
+  if (!gst_element_seek(pipeline, rate, GST_FORMAT_TIME,
+                        static_cast<GstSeekFlags>(flags), GST_SEEK_TYPE_SET,
+                        position, GST_SEEK_TYPE_NONE, GST_CLOCK_TIME_NONE)) {
+    spdlog::error("[index] seek to {:.3f} s failed",
+                  static_cast<double>(target) / GST_SECOND);
+    seek_start = GST_CLOCK_TIME_NONE;
+    return false;
+  }
+  return true;
+}
+
+void MediaIndexer::LogSummary() const {
+  if (open_ms >= 0.0) {
+    spdlog::info("[index] open ms: {:.1f} ({})", open_ms,
+                 hit ? "indexed" : "not indexed");
+  }
+  if (snapped_seek_ms.Count() > 0) {
+    spdlog::info("[index] indexed keyframe seek ms: {}",
+                 snapped_seek_ms.Summary());
+  }
+  if (key_unit_seek_ms.Count() > 0) {
+    spdlog::info("[index] key unit seek ms: {}", key_unit_seek_ms.Summary());
+  }
+}
+
+bool BuildIndexes(const std::vector<std::string> &paths,
+                  const std::string &dir) {
+  bool success = true;
+
+  for (const auto &path : paths) {
+    auto start = Now();
+    MediaIndexer indexer{dir, path};
+    if (indexer.Complete()) {
+      spdlog::info("[index] {} is up to date", path);
+      continue;
+    }
+
+    auto pipeline = GstElementPtr{gst_pipeline_new("IndexPipeline")};
+    auto src = Make("filesrc");
+    auto typefind = Make("typefind");
+    auto parse = Make("parsebin");
+    if (!src || !typefind || !parse) {
+      return false;
+    }
+    g_object_set(src.get(), "location", path.c_str(), NULL);
+
+    indexer.Attach(pipeline.get(), typefind.get(), parse.get());
+    g_signal_connect(parse.get(), "pad-added", G_CALLBACK(LinkToFakesink),
+                     pipeline.get());
+
+    auto *src_ptr = src.get();
+    auto *typefind_ptr = typefind.get();
+    auto *parse_ptr = parse.get();
+    for (auto *elem : {&src, &typefind, &parse}) {
+      gst_bin_add(GST_BIN(pipeline.get()), elem->release());
+    }
+    if (LinkAll({{src_ptr, typefind_ptr, parse_ptr}}) != LinkResult::SUCCESS) {
+      return false;
+    }
+
+    auto bus = GstBusPtr{gst_pipeline_get_bus(GST_PIPELINE(pipeline.get()))};
+    gst_element_set_state(pipeline.get(), GST_STATE_PLAYING);
+
+    bool done = false;
+    while (!done) {
+      auto msg = GstMessagePtr{
+          gst_bus_timed_pop_filtered(
+              bus.get(), GST_CLOCK_TIME_NONE,
+              static_cast<GstMessageType>(GST_MESSAGE_EOS | GST_MESSAGE_ERROR |
+                                          GST_MESSAGE_TAG |
+                                          GST_MESSAGE_ASYNC_DONE)),
+          &gst_message_unref};
+      switch (GST_MESSAGE_TYPE(msg.get())) {
+        case GST_MESSAGE_TAG:
+          indexer.OnTag(msg.get());
+          break;
+        case GST_MESSAGE_ASYNC_DONE:
+          indexer.OnAsyncDone();
+          break;
+        case GST_MESSAGE_EOS:
+          indexer.OnAsyncDone();
+          indexer.OnEos();
+          done = true;
+          break;
+        default:
+          PrintErrorMessage(msg.get());
+          success = false;
+          done = true;
+          break;
+      }
+    }
+    gst_element_set_state(pipeline.get(), GST_STATE_NULL);
+
+    spdlog::info("[index] indexed {} in {:.1f} ms", path,
+                 ToMs(Now() - start));
+  }
+
+  return success;
+}
+
+}  // namespace player
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <mutex>
+#include <optional>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <gst/gst.h>
+
+#include "gst_utils.h"
+#include "histogram.h"
+
+namespace player {
+
+// What has to be discovered about a file before it plays, cached per file.
+struct MediaIndex {
+  // caps typefind found for the file
+  std::string container;
+  // caps of every elementary stream parsebin exposed
+  std::vector<std::string> streams;
+  GstClockTime duration = GST_CLOCK_TIME_NONE;
+  // serialized GstTagList, every tag with its latest value
+  std::string tags;
+  // stream times of the video keyframes
+  std::set<GstClockTime> keyframes;
+  // the whole file was seen, every keyframe is known
+  bool complete = false;
+};
+
+// The default cache directory, under XDG_CACHE_HOME.
+std::string DefaultIndexDir();
+
+// Indexes are keyed by the canonical path, the size and the modification
+// time of the file, a changed file is a miss.
+std::optional<MediaIndex> LoadIndex(const std::string &dir,
+                                    const std::string &path);
+bool SaveIndex(const std::string &dir, const std::string &path,
+               const MediaIndex &index);
+
+// Loads the index of a file when it's opened, records what's missing while
+// it plays and saves it again. With an index typefind is given the container
+// caps instead of scanning the file, and seeks target a known keyframe. Seeks
+// are TIME seeks either way, the demuxer still looks the position up in its
+// own sample table. Open and seek times are logged for both cases.
+class MediaIndexer {
+ public:
+  // An empty `dir` disables the cache, times are still logged.
+  MediaIndexer(std::string dir, std::string path);
+  ~MediaIndexer();
+
+  MediaIndexer(const MediaIndexer &other) = delete;
+  MediaIndexer &operator=(const MediaIndexer &) = delete;
+
+  // `typefind` and `parse` are the elements in front of the demuxer, call
+  // before the pipeline starts.
+  void Attach(GstElement *pipeline, GstElement *typefind, GstElement *parse);
+
+  bool Hit() const { return hit; }
+  bool Complete();
+
+  // Merged into the known tags, later values replace earlier ones. Returns
+  // false if nothing changed.
+  bool OnTag(GstMessage *msg);
+  void OnAsyncDone();
+  void OnEos();
+
+  void OnOpen();
+  // A flushing key unit seek to `target`, or an accurate one to the indexed
+  // keyframe before it if the index is complete, so the seek lands on a
+  // keyframe even where the demuxer ignores KEY_UNIT.
+  bool Seek(GstClockTime target, double rate, bool segment);
+
+  void LogSummary() const;
+
+ private:
+  static void PadAdded(GstElement *element, GstPad *pad, gpointer user_data);
+  static void HaveType(GstElement *typefind, guint probability, GstCaps *caps,
+                       gpointer user_data);
+  static GstPadProbeReturn RecordKeyframe(GstPad *pad, GstPadProbeInfo *info,
+                                          gpointer user_data);
+
+  std::string dir;
+  std::string path;
+  bool hit = false;
+  bool changed = false;
+
+  GstElement *pipeline = nullptr;
+  GstPadPtr video_pad;
+  gulong probe = 0;
+
+  // the keyframes are recorded on the streaming thread
+  std::mutex mutex;
+  MediaIndex index;
+  // serialized into `index.tags` when saving, nullptr until tags are known
+  GstTagListPtr tags{nullptr, &gst_tag_list_unref};
+
+  // written by the video streaming thread only
+  GstSegment segment;
+  // start of the first segment, where the file begins
+  GstClockTime file_start = GST_CLOCK_TIME_NONE;
+  // every keyframe since the file start was seen, any seek (user, rate,
+  // recovery, throttle) that doesn't go back to the start clears it; loops
+  // and seeks to the start set it again. Guarded by `mutex`.
+  bool contiguous = false;
+
+  GstClockTime open_start = GST_CLOCK_TIME_NONE;
+  double open_ms = -1.0;
+  GstClockTime seek_start = GST_CLOCK_TIME_NONE;
+  bool seek_snapped = false;
+  utils::Histogram snapped_seek_ms;
+  utils::Histogram key_unit_seek_ms;
+};
+
+// Indexes every file without decoding it, for --build-index. Files with a
+// complete, current index are skipped.
+bool BuildIndexes(const std::vector<std::string> &paths,
+                  const std::string &dir);
+
+}  // namespace player
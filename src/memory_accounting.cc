@@ -0,0 +1,282 @@
+#include "memory_accounting.h"
+
+#include <algorithm>
+#include <mutex>
+#include <string>
+
+#include <gst/gst.h>
+#include <gst/video/video.h>
+#include <spdlog/spdlog.h>
+
+#include "tracing.h"
+
+namespace player {
+namespace {
+
+constexpr GstClockTime kSampleInterval = GST_SECOND;
+
+// startup peaks (preroll, initial queue fill) are not steady state
+constexpr GstClockTime kWarmup = 5 * GST_SECOND;
+
+// waylandsink keeps the displayed buffer and the one pending release by the
+// compositor
+constexpr guint64 kSinkHeldBuffers = 2;
+
+constexpr guint kMinQueueBytes = 256 * 1024;
+constexpr guint64 kMinQueueTime = 200 * GST_MSECOND;
+
+double ToMB(guint64 bytes) { return bytes / (1024.0 * 1024.0); }
+
+GstClockTime Now() { return gst_util_get_timestamp(); }
+
+}  // namespace
+
+MemoryAccounting::MemoryAccounting(GstElement *pipeline, guint64 budget_bytes)
+    : pipeline(pipeline), budget(budget_bytes) {
+  auto *bin = GST_BIN(pipeline);
+  queue_video = GstElementPtr{gst_bin_get_by_name(bin, "queuevideo")};
+  queue_audio = GstElementPtr{gst_bin_get_by_name(bin, "queueaudio")};
+  decoder = GstElementPtr{gst_bin_get_by_name(bin, "decodevideo")};
+
+  if (decoder) {
+    decoder_src = GstPadPtr{gst_element_get_static_pad(decoder.get(), "src")};
+    allocation_probe = gst_pad_add_probe(
+        decoder_src.get(), GST_PAD_PROBE_TYPE_QUERY_DOWNSTREAM, LimitPool,
+        this, nullptr);
+  }
+
+  if (auto sink = GstElementPtr{gst_bin_get_by_name(bin, "sinkvideo")}) {
+    sink_pad = GstPadPtr{gst_element_get_static_pad(sink.get(), "sink")};
+    rendered_probe =
+        gst_pad_add_probe(sink_pad.get(), GST_PAD_PROBE_TYPE_BUFFER,
+                          TrackRendered, this, nullptr);
+  }
+
+  if (budget > 0) {
+    spdlog::info("[memory] budget {:.1f} MB", ToMB(budget));
+  }
+}
+
+MemoryAccounting::~MemoryAccounting() {
+  if (decoder_src) {
+    gst_pad_remove_probe(decoder_src.get(), allocation_probe);
+  }
+  if (sink_pad) {
+    gst_pad_remove_probe(sink_pad.get(), rendered_probe);
+  }
+  LogReport();
+}
+
+GstPadProbeReturn MemoryAccounting::LimitPool(GstPad *pad,
+                                              GstPadProbeInfo *info,
+                                              gpointer user_data) {
+  auto *accounting = static_cast<MemoryAccounting *>(user_data);
+  auto *query = GST_PAD_PROBE_INFO_QUERY(info);
+
+  // only touch the answer from downstream
+  if (GST_QUERY_TYPE(query) != GST_QUERY_ALLOCATION ||
+      !(GST_PAD_PROBE_INFO_TYPE(info) & GST_PAD_PROBE_TYPE_PULL)) {
+    return GST_PAD_PROBE_OK;
+  }
+
+  guint limit = accounting->pool_limit;
+  for (guint i = 0; i < gst_query_get_n_allocation_pools(query); i++) {
+    GstBufferPool *pool = nullptr;
+    guint size, min, max;
+    gst_query_parse_nth_allocation_pool(query, i, &pool, &size, &min, &max);
+    if (limit > 0 && (max == 0 || max > limit)) {
+      max = std::max(min, limit);
+      gst_query_set_nth_allocation_pool(query, i, pool, size, min, max);
+      spdlog::info("[memory] limiting decoder pool to {} buffers", max);
+    }
+    if (pool) {
+      gst_object_unref(pool);
+    }
+    // the decoder uses the first pool
+    if (i == 0) {
+      std::lock_guard lock{accounting->pool_mutex};
+      accounting->pool = PoolParams{size, min, max};
+    }
+  }
+
+  return GST_PAD_PROBE_OK;
+}
+
+GstPadProbeReturn MemoryAccounting::TrackRendered(GstPad *pad,
+                                                  GstPadProbeInfo *info,
+                                                  gpointer user_data) {
+  auto *accounting = static_cast<MemoryAccounting *>(user_data);
+  accounting->rendered_size =
+      gst_buffer_get_size(GST_PAD_PROBE_INFO_BUFFER(info));
+  return GST_PAD_PROBE_OK;
+}
+
+MemoryAccounting::PoolParams MemoryAccounting::DecoderPool() {
+  {
+    std::lock_guard lock{pool_mutex};
+    if (pool) {
+      return *pool;
+    }
+  }
+
+  // nothing proposed downstream, the decoder configured its own pool
+  if (!decoder || !GST_IS_VIDEO_DECODER(decoder.get())) {
+    return {};
+  }
+  auto decoder_pool = GstObjectPtr{GST_OBJECT_CAST(
+      gst_video_decoder_get_buffer_pool(GST_VIDEO_DECODER(decoder.get())))};
+  if (!decoder_pool) {
+    return {};
+  }
+  PoolParams params;
+  auto *config =
+      gst_buffer_pool_get_config(GST_BUFFER_POOL(decoder_pool.get()));
+  gst_buffer_pool_config_get_params(config, nullptr, &params.size,
+                                    &params.min, &params.max);
+  gst_structure_free(config);
+  return params;
+}
+
+guint64 MemoryAccounting::DecoderPoolBytes() {
+  // an unlimited pool is counted at its preallocated minimum
+  auto params = DecoderPool();
+  return guint64{params.size} * (params.max > 0 ? params.max : params.min);
+}
+
+void MemoryAccounting::Update(Stage &stage, guint64 bytes, bool steady) {
+  stage.current = bytes;
+  stage.peak = std::max(stage.peak, bytes);
+  if (steady) {
+    stage.steady_sum += bytes;
+    stage.steady_samples++;
+  }
+  tracing::Counter(("memory MB " + stage.name).c_str(), ToMB(bytes));
+}
+
+void MemoryAccounting::Sample() {
+  auto now = Now();
+  if (!GST_CLOCK_TIME_IS_VALID(start)) {
+    start = now;
+  }
+  if (GST_CLOCK_TIME_IS_VALID(last_sample) &&
+      now - last_sample < kSampleInterval) {
+    return;
+  }
+  last_sample = now;
+
+  bool steady = now - start >= kWarmup;
+
+  for (auto [queue, stage] :
+       {std::pair{queue_video.get(), &queue_video_stage},
+        std::pair{queue_audio.get(), &queue_audio_stage}}) {
+    if (queue) {
+      guint bytes = 0;
+      g_object_get(queue, "current-level-bytes", &bytes, NULL);
+      Update(*stage, bytes, steady);
+    }
+  }
+
+  if (decoder) {
+    Update(decoder_stage, DecoderPoolBytes(), steady);
+  }
+  if (sink_pad) {
+    Update(sink_stage, rendered_size * kSinkHeldBuffers, steady);
+  }
+
+  // the sink holds decoder pool buffers, don't count them twice
+  auto total = queue_video_stage.current + queue_audio_stage.current +
+               decoder_stage.current;
+  bool over = budget > 0 && total > budget;
+  if (over != over_budget) {
+    if (over) {
+      spdlog::warn("[memory] {:.1f} MB over the {:.1f} MB budget",
+                   ToMB(total), ToMB(budget));
+    } else {
+      spdlog::info("[memory] {:.1f} MB, back under the budget", ToMB(total));
+    }
+    over_budget = over;
+  }
+  if (!over) {
+    exhausted = false;
+    return;
+  }
+
+  // one warning when there's nothing left, not one per sample
+  bool reduced = Reduce();
+  if (!reduced && !exhausted) {
+    spdlog::warn("[memory] nothing left to reduce, {:.1f} MB over budget",
+                 ToMB(total - budget));
+  }
+  exhausted = !reduced;
+}
+
+bool MemoryAccounting::ShrinkQueue(GstElement *queue) {
+  if (!queue) {
+    return false;
+  }
+
+  guint max_bytes = 0;
+  guint64 max_time = 0;
+  g_object_get(queue, "max-size-bytes", &max_bytes, "max-size-time", &max_time,
+               NULL);
+
+  auto new_bytes = std::max(max_bytes / 2, kMinQueueBytes);
+  auto new_time = std::max(max_time / 2, kMinQueueTime);
+  if (new_bytes >= max_bytes && new_time >= max_time) {
+    return false;
+  }
+
+  g_object_set(queue, "max-size-bytes", new_bytes, "max-size-time", new_time,
+               NULL);
+  spdlog::info(
+      "[memory] {}: max-size-bytes {} -> {}, max-size-time {} -> {} ms",
+      GetObjectName(queue), max_bytes, new_bytes, max_time / GST_MSECOND,
+      new_time / GST_MSECOND);
+  return true;
+}
+
+bool MemoryAccounting::Reduce() {
+  // queues first, they only cost buffering headroom
+  if (ShrinkQueue(queue_video.get()) || ShrinkQueue(queue_audio.get())) {
+    return true;
+  }
+
+  auto params = DecoderPool();
+  if (params.size == 0) {
+    return false;
+  }
+
+  auto allocated = params.max > 0 ? params.max : params.min;
+  auto limit = std::max(params.min, allocated > 0 ? allocated - 1 : 0u);
+  if (limit >= allocated) {
+    return false;
+  }
+  // the last limit wasn't negotiated yet, wait for it
+  if (pool_limit != 0 && limit >= pool_limit) {
+    return true;
+  }
+
+  spdlog::info("[memory] decoder pool {} -> {} buffers (min {}, max {})",
+               allocated, limit, params.min, params.max);
+  pool_limit = limit;
+
+  // the decoder renegotiates and sends a new allocation query
+  gst_pad_mark_reconfigure(decoder_src.get());
+  return true;
+}
+
+void MemoryAccounting::LogReport() const {
+  for (const auto *stage : {&queue_video_stage, &queue_audio_stage,
+                            &decoder_stage, &sink_stage}) {
+    if (stage->peak == 0) {
+      continue;
+    }
+    auto steady = stage->steady_samples > 0
+                      ? stage->steady_sum / stage->steady_samples
+                      : stage->current;
+    spdlog::info("[memory] {}: peak {:.2f} MB, steady {:.2f} MB", stage->name,
+                 ToMB(stage->peak), ToMB(steady));
+  }
+}
+
+}  // namespace player
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include <gst/gst.h>
+
+#include "gst_utils.h"
+
+namespace player {
+
+// Tracks the bytes held by the queues, the video decoder's buffer pool and
+// the video sink. When a budget is set and exceeded, queue limits and then
+// the decoder pool are shrunk one step per sample.
+class MemoryAccounting {
+ public:
+  // Elements are looked up by name, missing ones are skipped.
+  MemoryAccounting(GstElement *pipeline, guint64 budget_bytes);
+  ~MemoryAccounting();
+
+  MemoryAccounting(const MemoryAccounting &other) = delete;
+  MemoryAccounting &operator=(const MemoryAccounting &) = delete;
+
+  // Rate limited, cheap to call on every loop iteration.
+  void Sample();
+
+  void LogReport() const;
+
+ private:
+  struct Stage {
+    std::string name;
+    guint64 current = 0;
+    guint64 peak = 0;
+    guint64 steady_sum = 0;
+    uint64_t steady_samples = 0;
+  };
+
+  // buffer pool parameters of the negotiated allocation
+  struct PoolParams {
+    guint size = 0;
+    guint min = 0;
+    // 0 is unlimited
+    guint max = 0;
+  };
+
+  static GstPadProbeReturn LimitPool(GstPad *pad, GstPadProbeInfo *info,
+                                     gpointer user_data);
+  static GstPadProbeReturn TrackRendered(GstPad *pad, GstPadProbeInfo *info,
+                                         gpointer user_data);
+
+  PoolParams DecoderPool();
+  guint64 DecoderPoolBytes();
+  void Update(Stage &stage, guint64 bytes, bool steady);
+  // Returns false if there's nothing left to shrink.
+  bool Reduce();
+  bool ShrinkQueue(GstElement *queue);
+
+  GstElement *pipeline;
+  guint64 budget;
+
+  GstElementPtr queue_video;
+  GstElementPtr queue_audio;
+  GstElementPtr decoder;
+  GstPadPtr decoder_src;
+  GstPadPtr sink_pad;
+  gulong allocation_probe = 0;
+  gulong rendered_probe = 0;
+
+  // recorded from the allocation query, the pool preallocates min buffers
+  // and never holds more than max
+  std::mutex pool_mutex;
+  std::optional<PoolParams> pool;
+
+  std::atomic<guint> pool_limit = 0;
+  std::atomic<guint64> rendered_size = 0;
+
+  Stage queue_video_stage{"queuevideo"};
+  Stage queue_audio_stage{"queueaudio"};
+  Stage decoder_stage{"decoder pool"};
+  Stage sink_stage{"waylandsink"};
+
+  // state of the last sample, changes are logged
+  bool over_budget = false;
+  bool exhausted = false;
+
+  GstClockTime start = GST_CLOCK_TIME_NONE;
+  GstClockTime last_sample = GST_CLOCK_TIME_NONE;
+};
+
+}  // namespace player
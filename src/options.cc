@@ -0,0 +1,205 @@
+#include "options.h"
+
+#include <algorithm>
+#include <memory>
+#include <optional>
+#include <string_view>
+
+#include <glib.h>
+#include <spdlog/spdlog.h>
+
+#include "gst_utils.h"
+#include "media_index.h"
+
+namespace player {
+namespace {
+
+constexpr const char *kDefaultInput =
+    "/home/tom/Downloads/bourne_ultimatum_trailer/video.mp4";
+constexpr const char *kDefaultSubtitleFont =
+    "/usr/share/fonts/truetype/dejavu/DejaVuSans.ttf";
+constexpr int kDefaultSubtitleSize = 32;
+constexpr int kDefaultLiveLatencyMs = 20;
+constexpr int kDefaultReplaySeconds = 30;
+constexpr const char *kDefaultSnapshotFormat = "jpeg";
+constexpr double kDefaultSnapshotInterval = 1.0;
+
+using GOptionContextPtr =
+    std::unique_ptr<GOptionContext, decltype(&g_option_context_free)>;
+
+}  // namespace
+
+std::optional<Options> ParseOptions(int *argc, char ***argv) {
+  gchar *trace_path = nullptr;
+  gchar *subtitles = nullptr;
+  gchar *subtitle_font = nullptr;
+  gint subtitle_size = kDefaultSubtitleSize;
+  gint live_latency_ms = kDefaultLiveLatencyMs;
+  gint memory_budget_mb = 0;
+  gchar *snapshot_dir = nullptr;
+  gchar *snapshot_format = nullptr;
+  gdouble snapshot_interval = kDefaultSnapshotInterval;
+  gboolean loop = FALSE;
+  gint outputs = 1;
+  gboolean spectrum = FALSE;
+  gboolean software = FALSE;
+  gint timeshift_mb = 0;
+  gint replay_seconds = kDefaultReplaySeconds;
+  gchar *index_dir = nullptr;
+  gboolean no_index = FALSE;
+  gboolean build_index = FALSE;
+  gboolean stats = FALSE;
+  gint clip_cache_mb = 0;
+
+  GOptionEntry entries[] = {
+      {"trace", 0, 0, G_OPTION_ARG_FILENAME, &trace_path,
+       "Write a Chrome/Perfetto trace of the session to FILE", "FILE"},
+      {"subtitles", 0, 0, G_OPTION_ARG_FILENAME, &subtitles,
+       "Load subtitles from an external SRT/SSA FILE", "FILE"},
+      {"subtitle-font", 0, 0, G_OPTION_ARG_FILENAME, &subtitle_font,
+       "TrueType font used for subtitles", "FILE"},
+      {"subtitle-size", 0, 0, G_OPTION_ARG_INT, &subtitle_size,
+       "Subtitle font size in pixels", "PX"},
+      {"live-latency", 0, 0, G_OPTION_ARG_INT, &live_latency_ms,
+       "Jitter buffer latency for udp:// inputs", "MS"},
+      {"memory-budget", 0, 0, G_OPTION_ARG_INT, &memory_budget_mb,
+       "Shrink queues and the decoder pool to stay under MB", "MB"},
+      {"outputs", 0, 0, G_OPTION_ARG_INT, &outputs,
+       "Show the video in N windows from a single decode", "N"},
+      {"software", 0, 0, G_OPTION_ARG_NONE, &software,
+       "Convert and draw video with SDL instead of a wayland sink", nullptr},
+      {"spectrum", 0, 0, G_OPTION_ARG_NONE, &spectrum,
+       "Show an audio spectrum in the overlay", nullptr},
+      {"timeshift", 0, 0, G_OPTION_ARG_INT, &timeshift_mb,
+       "Keep the last MB of compressed video for instant replay", "MB"},
+      {"replay", 0, 0, G_OPTION_ARG_INT, &replay_seconds,
+       "Seconds replayed when pressing R", "SEC"},
+      {"loop", 0, 0, G_OPTION_ARG_NONE, &loop,
+       "Loop the file seamlessly instead of exiting at the end", nullptr},
+      {"snapshot-dir", 0, 0, G_OPTION_ARG_FILENAME, &snapshot_dir,
+       "Periodically save the displayed frame to DIR", "DIR"},
+      {"snapshot-format", 0, 0, G_OPTION_ARG_STRING, &snapshot_format,
+       "Snapshot image format, png or jpeg", "FORMAT"},
+      {"snapshot-interval", 0, 0, G_OPTION_ARG_DOUBLE, &snapshot_interval,
+       "Seconds between snapshots", "SEC"},
+      {"index-dir", 0, 0, G_OPTION_ARG_FILENAME, &index_dir,
+       "Cache media indexes in DIR", "DIR"},
+      {"no-index", 0, 0, G_OPTION_ARG_NONE, &no_index,
+       "Probe files on every open instead of using the index", nullptr},
+      {"build-index", 0, 0, G_OPTION_ARG_NONE, &build_index,
+       "Index every FILE without playing it and exit", nullptr},
+      {"clip-cache", 0, 0, G_OPTION_ARG_INT, &clip_cache_mb,
+       "Keep up to MB of played files in memory", "MB"},
+      {"stats", 0, 0, G_OPTION_ARG_NONE, &stats,
+       "Publish stats to shared memory for player_stats", nullptr},
+      {nullptr, 0, 0, G_OPTION_ARG_NONE, nullptr, nullptr, nullptr}};
+
+  auto context = GOptionContextPtr{g_option_context_new("[FILE|URI]"),
+                                   &g_option_context_free};
+  g_option_context_add_main_entries(context.get(), entries, nullptr);
+  g_option_context_set_ignore_unknown_options(context.get(), TRUE);
+
+  GError *error = nullptr;
+  if (!g_option_context_parse(context.get(), argc, argv, &error)) {
+    auto err = GlibErrorPtr{error, &g_error_free};
+    spdlog::error("Error parsing options: {}", err->message);
+    return {};
+  }
+
+  Options options;
+  options.input = kDefaultInput;
+  options.subtitle_font = kDefaultSubtitleFont;
+  options.subtitle_size = subtitle_size;
+  options.live_latency_ms = live_latency_ms;
+  options.memory_budget_mb = memory_budget_mb;
+  options.timeshift_mb = timeshift_mb;
+  options.replay_seconds = replay_seconds;
+  options.snapshot_format = kDefaultSnapshotFormat;
+  options.snapshot_interval = snapshot_interval;
+  options.stats = stats;
+  options.clip_cache_mb = clip_cache_mb;
+
+  if (auto path = GlibCharPtr{trace_path}) {
+    options.trace_path = path.get();
+  }
+  if (auto path = GlibCharPtr{subtitles}) {
+    options.subtitles = path.get();
+  }
+  if (auto path = GlibCharPtr{subtitle_font}) {
+    options.subtitle_font = path.get();
+  }
+  if (auto path = GlibCharPtr{snapshot_dir}) {
+    options.snapshot_dir = path.get();
+  }
+  if (auto format = GlibCharPtr{snapshot_format}) {
+    options.snapshot_format = format.get();
+  }
+  options.index_dir = DefaultIndexDir();
+  if (auto path = GlibCharPtr{index_dir}) {
+    options.index_dir = path.get();
+  }
+  if (no_index) {
+    options.index_dir.clear();
+  }
+
+  if (options.snapshot_format != "png" && options.snapshot_format != "jpeg") {
+    spdlog::error("Unsupported snapshot format: {}", options.snapshot_format);
+    return {};
+  }
+  // converted to unsigned nanoseconds, 0 would snapshot every iteration
+  if (!(snapshot_interval > 0)) {
+    spdlog::error("Invalid snapshot interval: {}", snapshot_interval);
+    return {};
+  }
+
+  for (int i = 1; i < *argc; i++) {
+    if ((*argv)[i][0] != '-') {
+      options.inputs.emplace_back((*argv)[i]);
+    }
+  }
+  if (!options.inputs.empty()) {
+    options.input = options.inputs.front();
+  }
+
+  options.build_index = build_index;
+  if (build_index && (options.inputs.empty() || options.index_dir.empty())) {
+    spdlog::error("--build-index needs files and an index directory");
+    return {};
+  }
+
+  std::string_view input = options.input;
+  options.live = input.starts_with(kV4l2Scheme) ||
+                 input.starts_with(kUdpScheme) ||
+                 input.starts_with(kTestScheme);
+
+  if (options.inputs.empty() || options.live) {
+    if (options.inputs.size() > 1) {
+      spdlog::warn("playlists are ignored for live inputs");
+    }
+    options.inputs = {options.input};
+  }
+
+  // a single file loops seamlessly, a playlist starts over
+  options.loop = loop && !options.live && options.inputs.size() == 1;
+  options.loop_playlist = loop && options.inputs.size() > 1;
+  if (loop && options.live) {
+    spdlog::warn("--loop is ignored for live inputs");
+  }
+
+  options.spectrum = spectrum && !options.live;
+
+  options.software = software && !options.live;
+  if (software && options.live) {
+    spdlog::warn("--software is ignored for live inputs");
+  }
+
+  options.outputs =
+      options.live || options.software ? 1 : std::max(outputs, 1);
+  if (outputs > 1 && options.outputs == 1) {
+    spdlog::warn("--outputs is ignored for live inputs and --software");
+  }
+
+  return options;
+}
+
+}  // namespace player
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace player {
+
+// live inputs, anything else is played as a file
+constexpr const char *kV4l2Scheme = "v4l2://";
+constexpr const char *kUdpScheme = "udp://";
+constexpr const char *kTestScheme = "test://";
+
+struct Options {
+  std::string input;
+  bool live;
+  // windows showing the same decoded video, files only
+  int outputs;
+  // restart files at the first frame with segment seeks instead of exiting
+  bool loop;
+  // rtpjitterbuffer latency for udp:// inputs
+  int live_latency_ms;
+  std::string trace_path;
+  std::string subtitles;
+  std::string subtitle_font;
+  int subtitle_size;
+  // 0 disables the budget, memory is accounted for either way
+  int memory_budget_mb;
+  // decode into an appsink and draw frames with SDL, files only
+  bool software;
+  // audio spectrum in the overlay, files only
+  bool spectrum;
+  // 0 disables the timeshift ring
+  int timeshift_mb;
+  int replay_seconds;
+  // snapshots are disabled without a directory
+  std::string snapshot_dir;
+  std::string snapshot_format;
+  double snapshot_interval;
+  // media index cache, empty with --no-index
+  std::string index_dir;
+  // index every file in `inputs` and exit
+  bool build_index;
+  // played in order, `input` is the one playing
+  std::vector<std::string> inputs;
+  // start over after the last of several inputs, --loop
+  bool loop_playlist;
+  // 0 disables the in-memory clip cache
+  int clip_cache_mb;
+  // publish stats to shared memory for player_stats
+  bool stats;
+};
+
+// Parses the player options and leaves everything it does not recognize
+// (e.g. --gst-debug) in argv for gst_init.
+std::optional<Options> ParseOptions(int *argc, char ***argv);
+
+}  // namespace player
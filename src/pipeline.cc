@@ -1,24 +1,80 @@
 #include "pipeline.h"
 
+#include <algorithm>
+#include <cstdlib>
 #include <cstring>
 #include <functional>
 #include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
 #include <vector>
 
 #define GST_USE_UNSTABLE_API
 
+#include <gio/gio.h>
+#include <gst/app/gstappsink.h>
+#include <gst/app/gstappsrc.h>
 #include <gst/gst.h>
 #include <gst/gstmessage.h>
 #include <gst/video/videooverlay.h>
 #include <gst/wayland/wayland.h>
+#include <spdlog/fmt/fmt.h>
 #include <spdlog/spdlog.h>
 
 #include <glib-2.0/glib/gstrfuncs.h>
 
+#include "audio_spectrum.h"
+#include "decode_throttle.h"
+#include "error_recovery.h"
+#include "latency_probe.h"
+#include "media_index.h"
+#include "memory_accounting.h"
+#include "playback_rate.h"
+#include "segment_loop.h"
+#include "stats_export.h"
+#include "timeshift.h"
+
 namespace player {
 
 namespace {
 
+constexpr const char *kRtpH264Caps =
+    "application/x-rtp, media=video, encoding-name=H264, clock-rate=90000";
+constexpr int kDefaultUdpPort = 5000;
+
+// each queued snapshot holds on to a decoder pool buffer
+constexpr size_t kSnapshotQueue = 2;
+
+// frames an output may fall behind before its oldest ones are dropped
+constexpr guint kOutputQueueBuffers = 3;
+constexpr GstClockTime kOutputLogInterval = 10 * GST_SECOND;
+
+constexpr GstClockTime kStatsInterval = 250 * GST_MSECOND;
+
+constexpr const char *kReplaySinkName = "replaysink";
+constexpr const char *kHardwareH264Decoder = "v4l2slh264dec";
+constexpr const char *kSoftwareH264Decoder = "avdec_h264";
+constexpr const char *kSoftwareCaps =
+    "video/x-raw, format=(string){NV12, I420}";
+
+// the first output keeps the name the rest of the player looks sinks up by
+std::string OutputSinkName(size_t output) {
+  return output == 0 ? "sinkvideo" : fmt::format("sinkvideo{}", output);
+}
+
+// the stateless V4L2 decoder where there is one, e.g. not on a desktop or
+// in a headless test compositor
+GstElementPtr MakeH264Decoder(const char *name) {
+  if (auto factory = GstObjectPtr{GST_OBJECT(
+          gst_element_factory_find(kHardwareH264Decoder))}) {
+    return Make(kHardwareH264Decoder, name);
+  }
+  spdlog::warn("{} isn't available, decoding with {}", kHardwareH264Decoder,
+               kSoftwareH264Decoder);
+  return Make(kSoftwareH264Decoder, name);
+}
+
 void PadAdded(GstElement *element, GstPad *pad, gpointer user_data) {
   GstElement *pipeline = GST_ELEMENT(user_data);
 
@@ -31,12 +87,20 @@ void PadAdded(GstElement *element, GstPad *pad, gpointer user_data) {
     queue = {gst_bin_get_by_name(GST_BIN(pipeline), "queuevideo"), {}};
   } else if (g_str_has_prefix(media_type, "audio")) {
     queue = {gst_bin_get_by_name(GST_BIN(pipeline), "queueaudio"), {}};
+  } else if (g_str_has_prefix(media_type, "text")) {
+    queue = {gst_bin_get_by_name(GST_BIN(pipeline), "queuetext"), {}};
   }
 
   if (queue) {
     auto sinkpad = GstPadPtr{gst_element_get_static_pad(queue.get(), "sink")};
+    if (gst_pad_is_linked(sinkpad.get())) {
+      // e.g. a second audio track or an external subtitle file
+      spdlog::info("PadAdded ignoring additional stream: {}", media_type);
+      return;
+    }
     if (LinkPads(pad, sinkpad.get()) != LinkResult::SUCCESS) {
-      exit(1);
+      // the unlinked stream fails with not-linked and goes through recovery
+      return;
     }
   } else {
     spdlog::error("PadAdded cannot handle: {}", media_type);
@@ -62,12 +126,9 @@ GstBusSyncReply BusSyncHandler(GstBus *bus, GstMessage *message,
   }
 
   if (gst_is_video_overlay_prepare_window_handle_message(message)) {
-    spdlog::info("Setting window handle for wayland");
-    GstVideoOverlay *videoOverlay = GST_VIDEO_OVERLAY(GST_MESSAGE_SRC(message));
-    pipe->SetOverlay(videoOverlay);
-    auto window_handle = (struct wl_surface *)pipe->Surface();
-    gst_video_overlay_set_window_handle(videoOverlay, (guintptr)window_handle);
-    gst_video_overlay_set_render_rectangle(videoOverlay, 0, 0, 1024, 768);
+    if (!pipe->SetWindowHandle(GST_MESSAGE_SRC(message))) {
+      return GST_BUS_PASS;
+    }
     gst_message_unref(message);
     return GST_BUS_DROP;
   }
@@ -75,80 +136,260 @@ GstBusSyncReply BusSyncHandler(GstBus *bus, GstMessage *message,
   return GST_BUS_PASS;
 }
 
-bool ProcessMessage(GstMessage *msg) {
-  bool terminate = false;
-
-  switch (GST_MESSAGE_TYPE(msg)) {
-    case GST_MESSAGE_ERROR: {
-      PrintErrorMessage(msg);
-      terminate = true;
-      break;
-    }
-    case GST_MESSAGE_EOS: {
-      spdlog::info("[eos]");
-      terminate = true;
-      break;
-    }
-    case GST_MESSAGE_STATE_CHANGED: {
-      PrintStateChangedMessage(msg);
-      break;
+// v4l2:///dev/video0, udp://HOST:PORT (RTP/H.264) or test://[PATTERN]
+std::vector<GstElementPtr> MakeLiveSource(const Options &options) {
+  std::string_view input = options.input;
+  std::vector<GstElementPtr> chain;
+
+  if (input.starts_with(kV4l2Scheme)) {
+    auto src = Make("v4l2src", "livesrc");
+    auto device = std::string{input.substr(strlen(kV4l2Scheme))};
+    g_object_set(src.get(), "device", device.c_str(), NULL);
+    chain.push_back(std::move(src));
+  } else if (input.starts_with(kUdpScheme)) {
+    auto address = input.substr(strlen(kUdpScheme));
+    auto separator = address.rfind(':');
+    auto host = std::string{address.substr(0, separator)};
+    int port = kDefaultUdpPort;
+    if (separator != std::string_view::npos) {
+      port = std::atoi(std::string{address.substr(separator + 1)}.c_str());
     }
-    case GST_MESSAGE_STREAM_STATUS: {
-      PrintStreamStatusMessage(msg);
-      break;
+
+    auto caps =
+        GstCapsPtr{gst_caps_from_string(kRtpH264Caps), &gst_caps_unref};
+    auto src = Make("udpsrc", "livesrc");
+    g_object_set(src.get(), "address", host.c_str(), "port", port, "caps",
+                 caps.get(), NULL);
+
+    auto jitter = Make("rtpjitterbuffer");
+    g_object_set(jitter.get(), "latency",
+                 static_cast<guint>(options.live_latency_ms), "drop-on-latency",
+                 TRUE, NULL);
+
+    chain.push_back(std::move(src));
+    chain.push_back(std::move(jitter));
+    chain.push_back(Make("rtph264depay"));
+    chain.push_back(Make("h264parse"));
+    auto decode = MakeH264Decoder("decodevideo");
+    if (decode) {
+      ConcealDecodeErrors(decode.get());
     }
-    case GST_MESSAGE_TAG: {
-      PrintTagMessage(msg);
-      break;
+    chain.push_back(std::move(decode));
+  } else {
+    auto src = Make("videotestsrc", "livesrc");
+    g_object_set(src.get(), "is-live", TRUE, NULL);
+    if (auto pattern = input.substr(strlen(kTestScheme)); !pattern.empty()) {
+      gst_util_set_object_arg(G_OBJECT(src.get()), "pattern",
+                              std::string{pattern}.c_str());
     }
-    default:
-      const gchar *message_type =
-          gst_message_type_get_name(GST_MESSAGE_TYPE(msg));
-      spdlog::info("[unknown] {}", message_type);
-      break;
+    chain.push_back(std::move(src));
   }
 
-  return terminate;
+  return chain;
 }
 }  // namespace
 
-VideoPipeline::VideoPipeline(const char *input, void *display, void *surface)
-    : display(display), surface(surface) {
+VideoPipeline::VideoPipeline(const Options &options, void *display,
+                             std::vector<VideoOutput> outputs,
+                             ClipCache *clips)
+    : display(display), clips(clips), outputs(std::move(outputs)) {
   pipeline = {gst_pipeline_new("VideoPipeline"), {}};
 
-  auto src = Make("filesrc");
-  g_object_set(src.get(), "location", input, NULL);
+  if (options.live) {
+    BuildLive(options);
+  } else {
+    BuildFile(options);
+  }
+
+  memory = std::make_unique<MemoryAccounting>(
+      pipeline.get(), static_cast<guint64>(options.memory_budget_mb) << 20);
+
+  if (!options.snapshot_dir.empty()) {
+    snapshots = std::make_unique<SnapshotWorker>(
+        options.snapshot_dir, options.snapshot_format, kSnapshotQueue,
+        options.input);
+  }
+
+  if (options.timeshift_mb > 0) {
+    // the parsed, still compressed stream is what the decoder consumes
+    auto decoder = GstElementPtr{
+        gst_bin_get_by_name(GST_BIN(pipeline.get()), "decodevideo")};
+    if (decoder) {
+      auto pad = GstPadPtr{gst_element_get_static_pad(decoder.get(), "sink")};
+      timeshift = std::make_unique<Timeshift>(
+          pad.get(), static_cast<guint64>(options.timeshift_mb) << 20);
+    } else {
+      spdlog::warn("[timeshift] input isn't compressed, timeshift disabled");
+    }
+  }
+
+  if (!options.live) {
+    rate = std::make_unique<PlaybackRate>(pipeline.get(), options.loop);
+  }
+  throttle = std::make_unique<DecodeThrottle>(pipeline.get(), options.live,
+                                              options.loop);
+  recovery = std::make_unique<ErrorRecovery>(pipeline.get(), options.live,
+                                             options.loop);
+
+  if (options.stats) {
+    stats_export = StatsExport::Create(pipeline.get());
+  }
+
+  bus = {gst_pipeline_get_bus(GST_PIPELINE(pipeline.get())), {}};
+  gst_bus_set_sync_handler(bus.get(), BusSyncHandler, this, NULL);
+}
+
+void VideoPipeline::BuildFile(const Options &options) {
+  auto bytes = clips ? clips->Get(options.input)
+                     : GBytesPtr{nullptr, &g_bytes_unref};
+  GstElementPtr src = nullptr;
+  if (bytes) {
+    // the stream holds its own reference, eviction doesn't free the bytes
+    src = Make("giostreamsrc");
+    auto *stream = g_memory_input_stream_new_from_bytes(bytes.get());
+    if (src) {
+      g_object_set(src.get(), "stream", stream, NULL);
+    }
+    g_object_unref(stream);
+  } else {
+    src = Make("filesrc");
+    g_object_set(src.get(), "location", options.input.c_str(), NULL);
+  }
 
+  // with an index typefind is told the container type instead of probing
+  auto typefind = Make("typefind");
   auto parse = Make("parsebin");
   g_signal_connect(parse.get(), "pad-added", (GCallback)PadAdded,
                    pipeline.get());
 
   auto queue_video = Make("queue", "queuevideo");
-  auto decode_video = Make("v4l2slh264dec");
-  auto sink_video = Make("waylandsink");
+  auto decode_video = MakeH264Decoder("decodevideo");
+  if (decode_video) {
+    ConcealDecodeErrors(decode_video.get());
+  }
+
+  // decoded once, the tee pushes the same buffer (by reference) to every
+  // output and answers the allocation query for all of them
+  auto tee_video = outputs.size() > 1 ? Make("tee", "teevideo") : nullptr;
+  std::vector<GstElementPtr> output_queues;
+  std::vector<GstElementPtr> output_sinks;
+  for (size_t i = 0; i < outputs.size(); i++) {
+    if (tee_video) {
+      auto queue = Make("queue", fmt::format("queueoutput{}", i).c_str());
+      g_object_set(queue.get(), "max-size-buffers", kOutputQueueBuffers,
+                   "max-size-bytes", 0, "max-size-time", guint64{0}, NULL);
+      gst_util_set_object_arg(G_OBJECT(queue.get()), "leaky", "downstream");
+      output_queues.push_back(std::move(queue));
+    }
+    auto sink = Make(options.software ? "appsink" : "waylandsink",
+                     OutputSinkName(i).c_str());
+    // late frames are reported upstream, so at high rates the decoder skips
+    // them instead of decoding frames the sink would drop anyway
+    if (sink) {
+      g_object_set(sink.get(), "qos", TRUE, NULL);
+    }
+    output_sinks.push_back(std::move(sink));
+  }
+  auto &sink_video = output_sinks.front();
+  if (options.software && sink_video) {
+    // frames are pulled and drawn by SDL, system memory keeps them mappable
+    auto caps =
+        GstCapsPtr{gst_caps_from_string(kSoftwareCaps), &gst_caps_unref};
+    g_object_set(sink_video.get(), "caps", caps.get(), "sync", TRUE,
+                 "max-buffers", 2, "drop", TRUE, NULL);
+    frame_sink = sink_video.get();
+  }
 
   auto queue_audio = Make("queue", "queueaudio");
   auto decode_audio = Make("avdec_aac");
   auto convert_audio = Make("audioconvert");
-  auto sink_audio = Make("pulsesink");
+  // keeps the pitch at any rate instead of playing the samples faster
+  auto tempo_audio = Make("scaletempo", "tempoaudio");
+  auto sink_audio = Make("pulsesink", "sinkaudio");
+
+  // doesn't take part in preroll, the media might not have a text stream
+  auto queue_text = Make("queue", "queuetext");
+  auto sink_text = Make("appsink", "subtitlesink");
+  g_object_set(sink_text.get(), "sync", TRUE, "async", FALSE, "max-buffers", 4,
+               "drop", TRUE, NULL);
 
   auto elements = std::vector<std::reference_wrapper<GstElementPtr>>{
-      src,         parse,        queue_video,   decode_video, sink_video,
-      queue_audio, decode_audio, convert_audio, sink_audio};
+      src,          typefind,     parse,         queue_video,
+      decode_video, queue_audio,  decode_audio,  convert_audio,
+      tempo_audio,  sink_audio,   queue_text,    sink_text};
+  if (tee_video) {
+    elements.push_back(tee_video);
+  }
+  for (auto *output_elements : {&output_queues, &output_sinks}) {
+    elements.insert(elements.end(), output_elements->begin(),
+                    output_elements->end());
+  }
+
+  GstElementPtr subtitle_src = nullptr;
+  GstElementPtr subtitle_parse = nullptr;
+  if (!options.subtitles.empty()) {
+    subtitle_src = Make("filesrc", "subtitlesrc");
+    g_object_set(subtitle_src.get(), "location", options.subtitles.c_str(),
+                 NULL);
+    subtitle_parse = Make("subparse");
+    elements.push_back(subtitle_src);
+    elements.push_back(subtitle_parse);
+  }
 
   if (std::any_of(elements.begin(), elements.end(),
                   [](auto elem) { return elem.get().get() == nullptr; })) {
-    exit(1);
+    throw PipelineError{"couldn't create the file pipeline"};
   }
 
   std::vector<std::vector<GstElement *>> elements_to_link = {
       // demux
-      {src.get(), parse.get()},
+      {src.get(), typefind.get(), parse.get()},
       // video pipe
-      {queue_video.get(), decode_video.get(), sink_video.get()},
+      {queue_video.get(), decode_video.get(),
+       tee_video ? tee_video.get() : sink_video.get()},
       // audio pipe
       {queue_audio.get(), decode_audio.get(), convert_audio.get(),
-       sink_audio.get()}};
+       tempo_audio.get(), sink_audio.get()},
+      // text pipe
+      {queue_text.get(), sink_text.get()}};
+
+  if (subtitle_src) {
+    elements_to_link.push_back(
+        {subtitle_src.get(), subtitle_parse.get(), queue_text.get()});
+  }
+
+  for (size_t i = 0; tee_video && i < outputs.size(); i++) {
+    elements_to_link.push_back(
+        {tee_video.get(), output_queues[i].get(), output_sinks[i].get()});
+
+    auto &stats = output_stats.emplace_back();
+    stats.queue = output_queues[i].get();
+    stats.sink = output_sinks[i].get();
+    g_signal_connect(stats.queue, "overrun", G_CALLBACK(QueueOverrun),
+                     &stats);
+  }
+
+  subtitle_sink = sink_text.get();
+  auto subtitle_pad =
+      GstPadPtr{gst_element_get_static_pad(sink_text.get(), "sink")};
+  gst_pad_add_probe(subtitle_pad.get(), GST_PAD_PROBE_TYPE_EVENT_FLUSH,
+                    SubtitleFlush, this, nullptr);
+
+  if (options.spectrum) {
+    // after audioconvert the samples are in the format the sink plays
+    auto pad =
+        GstPadPtr{gst_element_get_static_pad(convert_audio.get(), "src")};
+    spectrum = std::make_unique<AudioSpectrum>(pad.get());
+  }
+
+  indexer = std::make_unique<MediaIndexer>(options.index_dir, options.input);
+  indexer->Attach(pipeline.get(), typefind.get(), parse.get());
+
+  if (options.loop) {
+    auto sink_pad = GstPadPtr{
+        gst_element_get_static_pad(sink_video.get(), "sink")};
+    loop = std::make_unique<SegmentLoop>(pipeline.get(), sink_pad.get());
+  }
 
   // transfer ownership of elements to GstPipeline
   for (auto &elem : elements) {
@@ -156,21 +397,185 @@ VideoPipeline::VideoPipeline(const char *input, void *display, void *surface)
   }
 
   if (LinkAll(elements_to_link) != LinkResult::SUCCESS) {
-    exit(1);
+    throw PipelineError{"couldn't link the file pipeline"};
   }
+}
 
-  bus = {gst_pipeline_get_bus(GST_PIPELINE(pipeline.get())), {}};
-  gst_bus_set_sync_handler(bus.get(), BusSyncHandler, this, NULL);
+void VideoPipeline::BuildLive(const Options &options) {
+  auto chain = MakeLiveSource(options);
+
+  // a single frame in flight, stale frames are dropped instead of queued
+  auto queue_video = Make("queue", "queuevideo");
+  g_object_set(queue_video.get(), "max-size-buffers", 1, "max-size-bytes", 0,
+               "max-size-time", guint64{0}, NULL);
+  gst_util_set_object_arg(G_OBJECT(queue_video.get()), "leaky", "downstream");
+
+  // render frames as soon as they arrive, live sources don't preroll
+  auto sink_video = Make("waylandsink", "sinkvideo");
+  g_object_set(sink_video.get(), "sync", FALSE, "async", FALSE, NULL);
+
+  chain.push_back(std::move(queue_video));
+  chain.push_back(std::move(sink_video));
+
+  if (std::any_of(chain.begin(), chain.end(),
+                  [](const auto &elem) { return elem.get() == nullptr; })) {
+    throw PipelineError{"couldn't create the live pipeline"};
+  }
+
+  auto source_pad =
+      GstPadPtr{gst_element_get_static_pad(chain.front().get(), "src")};
+  auto sink_pad =
+      GstPadPtr{gst_element_get_static_pad(chain.back().get(), "sink")};
+
+  std::vector<GstElement *> elements_to_link;
+  for (auto &elem : chain) {
+    elements_to_link.push_back(elem.get());
+    gst_bin_add(GST_BIN(pipeline.get()), elem.release());
+  }
+
+  if (LinkAll({elements_to_link}) != LinkResult::SUCCESS) {
+    throw PipelineError{"couldn't link the live pipeline"};
+  }
+
+  latency_probe = std::make_unique<LatencyProbe>(
+      pipeline.get(), source_pad.get(), sink_pad.get());
 }
 
 VideoPipeline::~VideoPipeline() {
+  StopReplay();
+  LogOutputStats();
   gst_element_set_state(pipeline.get(), GST_STATE_NULL);
 }
 
+void VideoPipeline::SetVisible(bool visible) { throttle->SetVisible(visible); }
+
+void VideoPipeline::SetMuted(bool muted) { throttle->SetMuted(muted); }
+
+bool VideoPipeline::Muted() const { return throttle->Muted(); }
+
+bool VideoPipeline::SetRate(double value) {
+  if (!rate) {
+    spdlog::warn("[rate] live input plays at its own rate");
+    return false;
+  }
+  if (!rate->Set(value)) {
+    return false;
+  }
+  // later seeks must not fall back to normal speed
+  if (loop) {
+    loop->SetRate(rate->Current());
+  }
+  throttle->SetRate(rate->Current());
+  recovery->SetRate(rate->Current());
+  return true;
+}
+
+double VideoPipeline::Rate() const { return rate ? rate->Current() : 1.0; }
+
+bool VideoPipeline::SeekBy(GstClockTimeDiff offset) {
+  if (!indexer) {
+    spdlog::warn("[seek] live inputs can't seek");
+    return false;
+  }
+  gint64 position;
+  if (!gst_element_query_position(pipeline.get(), GST_FORMAT_TIME,
+                                  &position)) {
+    return false;
+  }
+  return indexer->Seek(std::max<gint64>(position + offset, 0), Rate(),
+                       loop != nullptr);
+}
+
 void VideoPipeline::Play() {
+  if (indexer) {
+    indexer->OnOpen();
+  }
   gst_element_set_state(pipeline.get(), GST_STATE_PLAYING);
 }
 
+bool VideoPipeline::ProcessMessage(GstMessage *msg) {
+  bool terminate = false;
+
+  switch (GST_MESSAGE_TYPE(msg)) {
+    case GST_MESSAGE_ERROR: {
+      PrintErrorMessage(msg);
+      stats.errors++;
+      // recovered once the bus is drained, later errors are usually fallout
+      recovery->OnError(msg);
+      break;
+    }
+    case GST_MESSAGE_QOS: {
+      stats.qos_messages++;
+      // late frames dropped by the decoder or the sink
+      if (rate) {
+        rate->OnQos(msg);
+      }
+      break;
+    }
+    case GST_MESSAGE_WARNING: {
+      PrintWarningMessage(msg);
+      stats.warnings++;
+      break;
+    }
+    case GST_MESSAGE_EOS: {
+      spdlog::info("[eos]");
+      if (indexer) {
+        indexer->OnEos();
+      }
+      at_end = true;
+      terminate = true;
+      break;
+    }
+    case GST_MESSAGE_ASYNC_DONE: {
+      spdlog::info("[async-done]");
+      recovery->OnPlaying();
+      if (indexer) {
+        indexer->OnAsyncDone();
+      }
+      if (loop) {
+        loop->Start();
+      }
+      break;
+    }
+    case GST_MESSAGE_SEGMENT_DONE: {
+      spdlog::info("[segment-done]");
+      stats.loops++;
+      // a whole iteration counts as having seen the file
+      if (indexer) {
+        indexer->OnEos();
+      }
+      if (loop) {
+        loop->Restart();
+      }
+      break;
+    }
+    case GST_MESSAGE_STATE_CHANGED: {
+      PrintStateChangedMessage(msg);
+      // live pipelines don't preroll, there's no async-done
+      recovery->OnStateChanged(msg);
+      break;
+    }
+    case GST_MESSAGE_STREAM_STATUS: {
+      PrintStreamStatusMessage(msg);
+      break;
+    }
+    case GST_MESSAGE_TAG: {
+      // tags the index knows were logged when it was loaded
+      if (!indexer || indexer->OnTag(msg)) {
+        PrintTagMessage(msg);
+      }
+      break;
+    }
+    default:
+      const gchar *message_type =
+          gst_message_type_get_name(GST_MESSAGE_TYPE(msg));
+      spdlog::info("[unknown] {}", message_type);
+      break;
+  }
+
+  return terminate;
+}
+
 bool VideoPipeline::ProcessMessages() {
   auto msg = GstMessagePtr{gst_bus_pop(bus.get()), &gst_message_unref};
   bool terminate = false;
@@ -180,15 +585,336 @@ bool VideoPipeline::ProcessMessages() {
     msg = GstMessagePtr{gst_bus_pop(bus.get()), &gst_message_unref};
   }
 
+  if (recovery->Pending()) {
+    terminate |= !recovery->Recover();
+  } else {
+    recovery->Track();
+  }
+
+  while (replay_bus) {
+    auto replay_msg =
+        GstMessagePtr{gst_bus_pop(replay_bus.get()), &gst_message_unref};
+    if (!replay_msg) {
+      break;
+    }
+    ProcessReplayMessage(replay_msg.get());
+  }
+
+  memory->Sample();
+  PublishStats();
+
+  if (!output_stats.empty()) {
+    auto now = gst_util_get_timestamp();
+    if (!GST_CLOCK_TIME_IS_VALID(last_output_log)) {
+      last_output_log = now;
+    } else if (now - last_output_log >= kOutputLogInterval) {
+      LogOutputStats();
+      last_output_log = now;
+    }
+  }
+
   return terminate;
 }
 
-void VideoPipeline::Resize(int width, int height) {
-  gst_video_overlay_set_render_rectangle(overlay, 0, 0, width, height);
+GstPadPtr VideoPipeline::SinkPad(size_t output) {
+  auto sink = GstElementPtr{gst_bin_get_by_name(
+      GST_BIN(pipeline.get()), OutputSinkName(output).c_str())};
+  if (!sink) {
+    return nullptr;
+  }
+  return GstPadPtr{gst_element_get_static_pad(sink.get(), "sink")};
+}
+
+bool VideoPipeline::SetWindowHandle(GstObject *sink) {
+  auto sink_name = GetObjectName(sink);
+  GstVideoOverlay *videoOverlay = GST_VIDEO_OVERLAY(sink);
+  VideoOutput target;
+  {
+    std::lock_guard lock{outputs_mutex};
+    auto *output = FindOutput(sink);
+    if (!output) {
+      spdlog::error("No output for {}", sink_name);
+      return false;
+    }
+    output->overlay = videoOverlay;
+    target = *output;
+  }
+  spdlog::info("Setting window handle for wayland: {}", sink_name);
+  auto window_handle = (struct wl_surface *)target.surface;
+  gst_video_overlay_set_window_handle(videoOverlay, (guintptr)window_handle);
+  gst_video_overlay_set_render_rectangle(videoOverlay, 0, 0, target.width,
+                                         target.height);
+  return true;
+}
+
+VideoOutput *VideoPipeline::FindOutput(GstObject *sink) {
+  auto name = GetObjectName(sink);
+  if (name == kReplaySinkName) {
+    return &replay_output;
+  }
+  for (size_t i = 0; i < outputs.size(); i++) {
+    if (name == OutputSinkName(i)) {
+      return &outputs[i];
+    }
+  }
+  return nullptr;
+}
+
+void VideoPipeline::Resize(size_t output, int width, int height) {
+  if (output >= outputs.size()) {
+    return;
+  }
+  GstVideoOverlay *overlays[2] = {};
+  {
+    std::lock_guard lock{outputs_mutex};
+    auto &target = outputs[output];
+    target.width = width;
+    target.height = height;
+    overlays[0] = target.overlay;
+
+    if (output == 0) {
+      replay_output.width = width;
+      replay_output.height = height;
+      overlays[1] = replay_output.overlay;
+    }
+  }
+
+  for (auto *overlay : overlays) {
+    if (overlay) {
+      gst_video_overlay_set_render_rectangle(overlay, 0, 0, width, height);
+    }
+  }
+}
+
+void VideoPipeline::QueueOverrun(GstElement *queue, gpointer user_data) {
+  // a leaky queue drops its oldest frame on every overrun
+  auto *stats = static_cast<OutputStats *>(user_data);
+  stats->overruns++;
+}
+
+void VideoPipeline::PublishStats() {
+  if (!stats_export) {
+    return;
+  }
+  auto now = gst_util_get_timestamp();
+  if (GST_CLOCK_TIME_IS_VALID(last_stats) &&
+      now - last_stats < kStatsInterval) {
+    return;
+  }
+  last_stats = now;
+
+  stats.rate = Rate();
+  stats.recoveries = recovery->Recoveries();
+  stats_export->Publish(stats);
+}
+
+void VideoPipeline::LogOutputStats() {
+  for (size_t i = 0; i < output_stats.size(); i++) {
+    auto &stats = output_stats[i];
+
+    guint64 rendered = 0;
+    guint64 late = 0;
+    GstStructure *sink_stats = nullptr;
+    g_object_get(stats.sink, "stats", &sink_stats, NULL);
+    if (auto structure = GstStructurePtr{sink_stats, &gst_structure_free}) {
+      gst_structure_get_uint64(structure.get(), "rendered", &rendered);
+      gst_structure_get_uint64(structure.get(), "dropped", &late);
+    }
+
+    spdlog::info("[output {}] rendered {}, dropped {} in queue, {} late", i,
+                 rendered, stats.overruns.load(), late);
+  }
 }
 
 void VideoPipeline::Pause() {
   gst_element_set_state(pipeline.get(), GST_STATE_PAUSED);
 }
 
+GstPadProbeReturn VideoPipeline::SubtitleFlush(GstPad *pad,
+                                               GstPadProbeInfo *info,
+                                               gpointer user_data) {
+  if (GST_EVENT_TYPE(GST_PAD_PROBE_INFO_EVENT(info)) == GST_EVENT_FLUSH_STOP) {
+    static_cast<VideoPipeline *>(user_data)->subtitles_flushed = true;
+  }
+  return GST_PAD_PROBE_OK;
+}
+
+bool VideoPipeline::SubtitlesFlushed() {
+  return subtitles_flushed.exchange(false);
+}
+
+std::optional<Subtitle> VideoPipeline::PullSubtitle() {
+  if (!subtitle_sink) {
+    return {};
+  }
+
+  auto sample = GstSamplePtr{
+      gst_app_sink_try_pull_sample(GST_APP_SINK(subtitle_sink), 0),
+      &gst_sample_unref};
+  if (!sample) {
+    return {};
+  }
+
+  GstBuffer *buffer = gst_sample_get_buffer(sample.get());
+  GstMapInfo map;
+  if (!buffer || !gst_buffer_map(buffer, &map, GST_MAP_READ)) {
+    return {};
+  }
+
+  Subtitle subtitle;
+  subtitle.text.assign(reinterpret_cast<const char *>(map.data), map.size);
+  gst_buffer_unmap(buffer, &map);
+
+  // subparse produces pango markup, tx3g and most embedded tracks utf8
+  GstStructure *caps_struct =
+      gst_caps_get_structure(gst_sample_get_caps(sample.get()), 0);
+  const gchar *format = gst_structure_get_string(caps_struct, "format");
+  subtitle.markup = format && g_str_equal(format, "pango-markup");
+
+  subtitle.end = GST_CLOCK_TIME_NONE;
+  if (GST_BUFFER_PTS_IS_VALID(buffer) && GST_BUFFER_DURATION_IS_VALID(buffer)) {
+    subtitle.end = gst_segment_to_running_time(
+        gst_sample_get_segment(sample.get()), GST_FORMAT_TIME,
+        GST_BUFFER_PTS(buffer) + GST_BUFFER_DURATION(buffer));
+  }
+
+  return subtitle;
+}
+
+GstSamplePtr VideoPipeline::PullVideoFrame() {
+  if (!frame_sink) {
+    return {nullptr, &gst_sample_unref};
+  }
+  return {gst_app_sink_try_pull_sample(GST_APP_SINK(frame_sink), 0),
+          &gst_sample_unref};
+}
+
+bool VideoPipeline::Snapshot() {
+  if (!snapshots) {
+    return false;
+  }
+
+  auto sink = GstElementPtr{
+      gst_bin_get_by_name(GST_BIN(pipeline.get()), "sinkvideo")};
+  if (!sink) {
+    return false;
+  }
+
+  GstSample *sample = nullptr;
+  g_object_get(sink.get(), "last-sample", &sample, NULL);
+  if (!sample) {
+    return false;
+  }
+
+  return snapshots->Submit(GstSamplePtr{sample, &gst_sample_unref});
+}
+
+bool VideoPipeline::Replay(GstClockTime duration) {
+  if (!timeshift) {
+    return false;
+  }
+  StopReplay();
+
+  replay_requested = gst_util_get_timestamp();
+  auto clip = timeshift->Extract(duration);
+  if (!clip) {
+    spdlog::warn("[replay] nothing recorded yet");
+    return false;
+  }
+  auto extracted = gst_util_get_timestamp();
+
+  auto src = Make("appsrc", "replaysrc");
+  auto decode = MakeH264Decoder("decodereplay");
+  auto sink = Make("waylandsink", kReplaySinkName);
+  if (!src || !decode || !sink) {
+    return false;
+  }
+
+  // the whole clip is queued up front, the buffers are only references
+  g_object_set(src.get(), "caps", clip->caps.get(), "format", GST_FORMAT_TIME,
+               "max-bytes", guint64{0}, NULL);
+
+  replay = {gst_pipeline_new("ReplayPipeline"), {}};
+  auto *app_src = GST_APP_SRC(src.get());
+  std::vector<GstElement *> elements_to_link = {src.get(), decode.get(),
+                                                sink.get()};
+  for (auto *elem : {&src, &decode, &sink}) {
+    gst_bin_add(GST_BIN(replay.get()), elem->release());
+  }
+  if (LinkAll({elements_to_link}) != LinkResult::SUCCESS) {
+    replay.reset();
+    return false;
+  }
+
+  {
+    std::lock_guard lock{outputs_mutex};
+    replay_output = outputs.front();
+    replay_output.overlay = nullptr;
+  }
+  replay_bus = {gst_pipeline_get_bus(GST_PIPELINE(replay.get())), {}};
+  gst_bus_set_sync_handler(replay_bus.get(), BusSyncHandler, this, NULL);
+
+  for (auto &buffer : clip->buffers) {
+    gst_app_src_push_buffer(app_src, buffer.release());
+  }
+  gst_app_src_end_of_stream(app_src);
+
+  gst_element_set_state(replay.get(), GST_STATE_PLAYING);
+
+  spdlog::info(
+      "[replay] {:.1f} s from {} buffers ({:.2f} MB), keyframe {:.0f} ms "
+      "early, extracted in {:.2f} ms",
+      static_cast<double>(clip->duration) / GST_SECOND, clip->buffers.size(),
+      clip->bytes / (1024.0 * 1024.0),
+      static_cast<double>(clip->preroll) / GST_MSECOND,
+      static_cast<double>(extracted - replay_requested) / GST_MSECOND);
+  timeshift->LogStats();
+  return true;
+}
+
+void VideoPipeline::ProcessReplayMessage(GstMessage *msg) {
+  switch (GST_MESSAGE_TYPE(msg)) {
+    case GST_MESSAGE_ASYNC_DONE: {
+      // waylandsink shows the preroll frame
+      spdlog::info("[replay] first frame after {:.2f} ms",
+                   static_cast<double>(gst_util_get_timestamp() -
+                                       replay_requested) /
+                       GST_MSECOND);
+      break;
+    }
+    case GST_MESSAGE_EOS: {
+      spdlog::info("[replay] done");
+      StopReplay();
+      break;
+    }
+    case GST_MESSAGE_ERROR: {
+      PrintErrorMessage(msg);
+      StopReplay();
+      break;
+    }
+    default:
+      break;
+  }
+}
+
+void VideoPipeline::StopReplay() {
+  if (!replay) {
+    return;
+  }
+  gst_element_set_state(replay.get(), GST_STATE_NULL);
+  replay_bus.reset();
+  replay.reset();
+  std::lock_guard lock{outputs_mutex};
+  replay_output.overlay = nullptr;
+}
+
+GstClockTime VideoPipeline::RunningTime() {
+  auto clock = GstClockPtr{gst_element_get_clock(pipeline.get())};
+  if (!clock) {
+    return GST_CLOCK_TIME_NONE;
+  }
+  return gst_clock_get_time(clock.get()) -
+         gst_element_get_base_time(pipeline.get());
+}
+
 }  // namespace player
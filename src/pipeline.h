@@ -1,37 +1,188 @@
 #pragma once
 
+#include <atomic>
 #include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <vector>
 
 #include <gst/gst.h>
 #include <gst/video/videooverlay.h>
 
+#include "audio_spectrum.h"
+#include "clip_cache.h"
+#include "decode_throttle.h"
+#include "error_recovery.h"
 #include "gst_utils.h"
+#include "latency_probe.h"
+#include "media_index.h"
+#include "memory_accounting.h"
+#include "options.h"
+#include "playback_rate.h"
+#include "segment_loop.h"
+#include "snapshot.h"
+#include "stats_export.h"
+#include "timeshift.h"
 
 namespace player {
 
+struct Subtitle {
+  std::string text;
+  bool markup;
+  // running time at which the subtitle should disappear
+  GstClockTime end;
+};
+
+// A window the decoded video is shown in, every output gets its own sink.
+struct VideoOutput {
+  void *surface;
+  int width;
+  int height;
+  // set once the sink asks for a window handle
+  GstVideoOverlay *overlay = nullptr;
+};
+
+// Thrown when the pipeline can't be built, errors while playing are
+// recovered from in place.
+class PipelineError : public std::runtime_error {
+ public:
+  using std::runtime_error::runtime_error;
+};
+
 class VideoPipeline {
  public:
-  explicit VideoPipeline(const char *input, void *display, void *surface);
+  // With more than one output the decoded buffers are split by a tee, each
+  // output is fed by its own leaky queue so a slow one can't stall the rest.
+  // Files are played from memory through `clips` when given.
+  explicit VideoPipeline(const Options &options, void *display,
+                         std::vector<VideoOutput> outputs,
+                         ClipCache *clips = nullptr);
   ~VideoPipeline();
 
   void Play();
   bool ProcessMessages();
+  // true once ProcessMessages stopped because the input ended, false when
+  // error recovery gave up
+  bool AtEnd() const { return at_end; }
 
   void *Display() { return display; }
-  void *Surface() { return surface; }
 
-  void SetOverlay(GstVideoOverlay *overlay) { this->overlay = overlay; }
-  void Resize(int width, int height);
+  // Hands the surface of the output rendered by `sink` to it, called from
+  // the streaming thread asking for a window. False for unknown elements.
+  bool SetWindowHandle(GstObject *sink);
+  void Resize(size_t output, int width, int height);
+
+  // The sink pad of the video sink of `output`, nullptr if there is none.
+  GstPadPtr SinkPad(size_t output);
 
   void Pause();
 
+  // While no output is visible only keyframes are decoded, while muted
+  // audio isn't decoded at all.
+  void SetVisible(bool visible);
+  void SetMuted(bool muted);
+  bool Muted() const;
+
+  // Between PlaybackRate::kMin and kMax, files only. Returns false if the
+  // rate couldn't be changed.
+  bool SetRate(double rate);
+  double Rate() const;
+
+  // Seeks files relative to the current position, to the keyframe before
+  // the target when the media index knows it.
+  bool SeekBy(GstClockTimeDiff offset);
+
+  // Subtitles are pulled from an appsink synced to the clock, so a subtitle
+  // is returned once its start time has been reached.
+  std::optional<Subtitle> PullSubtitle();
+  // True once after every flushing seek, the end of a subtitle shown before
+  // it is a running time that no longer applies.
+  bool SubtitlesFlushed();
+
+  GstClockTime RunningTime();
+
+  // The next decoded frame with --software, nullptr if there's none yet.
+  GstSamplePtr PullVideoFrame();
+
+  // Queues the frame currently shown by the sink for encoding on the
+  // snapshot worker. The sample is referenced, not copied. Returns false if
+  // snapshots are disabled, nothing was rendered yet or the queue is full.
+  bool Snapshot();
+
+  // nullptr unless the spectrum visualizer is enabled
+  AudioSpectrum *Spectrum() { return spectrum.get(); }
+
+  // Replays the last `duration` from the timeshift ring on top of the first
+  // output, the main pipeline keeps running. Returns false if there's no
+  // ring or nothing recorded yet.
+  bool Replay(GstClockTime duration);
+
  private:
+  void BuildFile(const Options &options);
+  void BuildLive(const Options &options);
+  bool ProcessMessage(GstMessage *msg);
+  // The output rendered by `sink`, nullptr for unknown elements.
+  VideoOutput *FindOutput(GstObject *sink);
+  void LogOutputStats();
+  void ProcessReplayMessage(GstMessage *msg);
+  void StopReplay();
+  void PublishStats();
+
+  // drop counters of one output, only used with more than one output
+  struct OutputStats {
+    GstElement *queue = nullptr;
+    GstElement *sink = nullptr;
+    std::atomic<guint64> overruns = 0;
+  };
+
+  static void QueueOverrun(GstElement *queue, gpointer user_data);
+  static GstPadProbeReturn SubtitleFlush(GstPad *pad, GstPadProbeInfo *info,
+                                         gpointer user_data);
+
   GstElementPtr pipeline;
   GstBusPtr bus;
 
+  GstElement *subtitle_sink = nullptr;
+  std::atomic<bool> subtitles_flushed = false;
+  GstElement *frame_sink = nullptr;
+
+  std::unique_ptr<LatencyProbe> latency_probe;
+  std::unique_ptr<MemoryAccounting> memory;
+  std::unique_ptr<SnapshotWorker> snapshots;
+  std::unique_ptr<SegmentLoop> loop;
+  std::unique_ptr<Timeshift> timeshift;
+  std::unique_ptr<AudioSpectrum> spectrum;
+  std::unique_ptr<MediaIndexer> indexer;
+  std::unique_ptr<PlaybackRate> rate;
+  std::unique_ptr<DecodeThrottle> throttle;
+  std::unique_ptr<ErrorRecovery> recovery;
+
+  std::optional<StatsExport> stats_export;
+  // counted from bus messages, the rest is queried when publishing
+  StatsSnapshot stats{};
+  GstClockTime last_stats = GST_CLOCK_TIME_NONE;
+
+  // separate pipeline decoding a clip from the timeshift ring
+  GstElementPtr replay;
+  GstBusPtr replay_bus;
+  VideoOutput replay_output{};
+  GstClockTime replay_requested = GST_CLOCK_TIME_NONE;
+
   void *display;
-  void *surface;
+  ClipCache *clips;
+  bool at_end = false;
 
-  GstVideoOverlay *overlay;
+  std::vector<VideoOutput> outputs;
+  // guards the size and overlay of `outputs` and `replay_output`, sinks ask
+  // for their window on a streaming thread. Never held while calling into a
+  // sink, waylandsink asks with its render lock held.
+  std::mutex outputs_mutex;
+  // a deque keeps the counters in place for the overrun signal handlers
+  std::deque<OutputStats> output_stats;
+  GstClockTime last_output_log = GST_CLOCK_TIME_NONE;
 };
 }  // namespace player
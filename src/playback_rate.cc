@@ -0,0 +1,241 @@
+#include "playback_rate.h"
+
+#include <algorithm>
+#include <ctime>
+
+#include <gst/gst.h>
+#include <spdlog/spdlog.h>
+
+#include "tracing.h"
+
+namespace player {
+namespace {
+
+uint64_t ProcessCpuNs() {
+  timespec time;
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &time);
+  return static_cast<uint64_t>(time.tv_sec) * 1000000000 + time.tv_nsec;
+}
+
+GstClockTime Now() { return gst_util_get_timestamp(); }
+
+}  // namespace
+
+PlaybackRate::PlaybackRate(GstElement *pipeline, bool segment)
+    : pipeline(pipeline),
+      segment(segment),
+      last_cpu_ns(ProcessCpuNs()),
+      last_wall(Now()) {
+  auto decoder =
+      GstElementPtr{gst_bin_get_by_name(GST_BIN(pipeline), "decodevideo")};
+  if (decoder) {
+    decoder_pad = GstPadPtr{gst_element_get_static_pad(decoder.get(), "src")};
+    probe = gst_pad_add_probe(decoder_pad.get(), GST_PAD_PROBE_TYPE_BUFFER,
+                              CountDecoded, this, nullptr);
+  }
+  if (auto tempo = GstElementPtr{
+          gst_bin_get_by_name(GST_BIN(pipeline), "tempoaudio")}) {
+    tempo_pad = GstPadPtr{gst_element_get_static_pad(tempo.get(), "sink")};
+  }
+  Watch(pushed_video, "queuevideo");
+  Watch(pushed_audio, "queueaudio");
+}
+
+PlaybackRate::~PlaybackRate() {
+  if (probe) {
+    gst_pad_remove_probe(decoder_pad.get(), probe);
+  }
+  for (auto *pushed : {&pushed_video, &pushed_audio}) {
+    if (pushed->probe) {
+      gst_pad_remove_probe(pushed->pad.get(), pushed->probe);
+    }
+  }
+  LogSummary();
+}
+
+void PlaybackRate::Watch(Pushed &pushed, const char *queue) {
+  gst_segment_init(&pushed.segment, GST_FORMAT_UNDEFINED);
+  auto element = GstElementPtr{gst_bin_get_by_name(GST_BIN(pipeline), queue)};
+  if (!element) {
+    return;
+  }
+  pushed.pad = GstPadPtr{gst_element_get_static_pad(element.get(), "sink")};
+  pushed.probe = gst_pad_add_probe(
+      pushed.pad.get(),
+      static_cast<GstPadProbeType>(GST_PAD_PROBE_TYPE_BUFFER |
+                                   GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM),
+      TrackPushed, &pushed, nullptr);
+}
+
+GstPadProbeReturn PlaybackRate::TrackPushed(GstPad *pad,
+                                            GstPadProbeInfo *info,
+                                            gpointer user_data) {
+  auto *pushed = static_cast<Pushed *>(user_data);
+
+  if (GST_PAD_PROBE_INFO_TYPE(info) & GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM) {
+    auto *event = GST_PAD_PROBE_INFO_EVENT(info);
+    if (GST_EVENT_TYPE(event) == GST_EVENT_SEGMENT) {
+      const GstSegment *segment;
+      gst_event_parse_segment(event, &segment);
+      gst_segment_copy_into(segment, &pushed->segment);
+    } else if (GST_EVENT_TYPE(event) == GST_EVENT_FLUSH_STOP) {
+      pushed->end = GST_CLOCK_TIME_NONE;
+    }
+    return GST_PAD_PROBE_OK;
+  }
+
+  auto *buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+  if (pushed->segment.format != GST_FORMAT_TIME ||
+      !GST_BUFFER_PTS_IS_VALID(buffer)) {
+    return GST_PAD_PROBE_OK;
+  }
+  auto end = GST_BUFFER_PTS(buffer);
+  if (GST_BUFFER_DURATION_IS_VALID(buffer)) {
+    end += GST_BUFFER_DURATION(buffer);
+  }
+  end = gst_segment_to_stream_time(&pushed->segment, GST_FORMAT_TIME, end);
+  if (GST_CLOCK_TIME_IS_VALID(end)) {
+    pushed->end = end;
+  }
+  return GST_PAD_PROBE_OK;
+}
+
+GstClockTime PlaybackRate::NextBoundary() const {
+  // demuxers interleave the streams, past the one that is ahead nothing is
+  // played twice; the other one loses at most the interleave
+  GstClockTime video = pushed_video.end;
+  GstClockTime audio = pushed_audio.end;
+  if (!GST_CLOCK_TIME_IS_VALID(video)) {
+    return audio;
+  }
+  if (!GST_CLOCK_TIME_IS_VALID(audio)) {
+    return video;
+  }
+  return std::max(video, audio);
+}
+
+GstPadProbeReturn PlaybackRate::CountDecoded(GstPad *pad,
+                                             GstPadProbeInfo *info,
+                                             gpointer user_data) {
+  static_cast<PlaybackRate *>(user_data)->decoded++;
+  return GST_PAD_PROBE_OK;
+}
+
+void PlaybackRate::Account() {
+  auto cpu = ProcessCpuNs();
+  auto wall = Now();
+  uint64_t frames = decoded;
+
+  auto &current = usage[rate];
+  current.wall_s += static_cast<double>(wall - last_wall) / GST_SECOND;
+  current.cpu_s += (cpu - last_cpu_ns) / 1e9;
+  current.decoded += frames - last_decoded;
+
+  last_cpu_ns = cpu;
+  last_wall = wall;
+  last_decoded = frames;
+}
+
+bool PlaybackRate::Set(double new_rate) {
+  new_rate = std::clamp(new_rate, kMin, kMax);
+  if (new_rate == rate) {
+    return true;
+  }
+
+  auto start = Now();
+  auto segment_flag = segment ? GST_SEEK_FLAG_SEGMENT : GST_SEEK_FLAG_NONE;
+
+  // the instant-rate-change event passes scaletempo by, the sink would play
+  // its 1x output faster and change the pitch
+  bool audio = false;
+  if (tempo_pad) {
+    auto caps = GstCapsPtr{gst_pad_get_current_caps(tempo_pad.get()),
+                           &gst_caps_unref};
+    audio = caps != nullptr;
+  }
+
+  // keeps the position and every queued buffer, the sinks switch to the new
+  // rate at once; the remaining flags have to match the current segment
+  bool instant = !audio && gst_element_seek(
+      pipeline, new_rate, GST_FORMAT_TIME,
+      static_cast<GstSeekFlags>(GST_SEEK_FLAG_INSTANT_RATE_CHANGE |
+                                segment_flag),
+      GST_SEEK_TYPE_NONE, GST_CLOCK_TIME_NONE, GST_SEEK_TYPE_NONE,
+      GST_CLOCK_TIME_NONE);
+
+  // the new segment follows the queued buffers, scaletempo takes the rate
+  // from it; buffers pushed while the seek is handled may repeat
+  bool queued = false;
+  if (!instant) {
+    auto boundary = NextBoundary();
+    queued = GST_CLOCK_TIME_IS_VALID(boundary) &&
+             gst_element_seek(
+                 pipeline, new_rate, GST_FORMAT_TIME,
+                 static_cast<GstSeekFlags>(GST_SEEK_FLAG_ACCURATE |
+                                           segment_flag),
+                 GST_SEEK_TYPE_SET, boundary, GST_SEEK_TYPE_NONE,
+                 GST_CLOCK_TIME_NONE);
+  }
+
+  if (!instant && !queued) {
+    gint64 position;
+    if (!gst_element_query_position(pipeline, GST_FORMAT_TIME, &position)) {
+      spdlog::warn("[rate] no position, keeping {:.2f}x", rate);
+      return false;
+    }
+    auto flags = static_cast<GstSeekFlags>(
+        GST_SEEK_FLAG_FLUSH | GST_SEEK_FLAG_ACCURATE | segment_flag);
+    if (!gst_element_seek(pipeline, new_rate, GST_FORMAT_TIME, flags,
+                          GST_SEEK_TYPE_SET, position, GST_SEEK_TYPE_NONE,
+                          GST_CLOCK_TIME_NONE)) {
+      spdlog::error("[rate] seek to {:.2f}x failed", new_rate);
+      return false;
+    }
+  }
+
+  Account();
+  spdlog::info("[rate] {:.2f}x -> {:.2f}x ({}, {:.1f} ms)", rate, new_rate,
+               instant ? "instant" : queued ? "after the queue" : "flushing",
+               static_cast<double>(Now() - start) / 1e6);
+  rate = new_rate;
+  tracing::Counter("rate", rate);
+  return true;
+}
+
+void PlaybackRate::OnQos(GstMessage *msg) {
+  GstFormat format;
+  guint64 processed, dropped;
+  gst_message_parse_qos_stats(msg, &format, &processed, &dropped);
+  if (format != GST_FORMAT_BUFFERS || dropped == static_cast<guint64>(-1)) {
+    return;
+  }
+
+  auto name = GetObjectName(GST_MESSAGE_SRC(msg));
+  auto &last = last_dropped[name];
+  // the counters start over when the element is reset
+  auto delta = dropped >= last ? dropped - last : dropped;
+  last = dropped;
+  usage[rate].dropped[name] += delta;
+}
+
+void PlaybackRate::LogSummary() {
+  Account();
+
+  for (const auto &[value, stats] : usage) {
+    if (stats.wall_s <= 0.0) {
+      continue;
+    }
+    spdlog::info(
+        "[rate] {:.2f}x: {:.1f} s, {:.1f} decoded fps, {:.1f}% of a core",
+        value, stats.wall_s, stats.decoded / stats.wall_s,
+        stats.cpu_s / stats.wall_s * 100.0);
+    for (const auto &[element, dropped] : stats.dropped) {
+      if (dropped > 0) {
+        spdlog::info("[rate] {:.2f}x: {} dropped {} frames", value, element,
+                     dropped);
+      }
+    }
+  }
+}
+
+}  // namespace player
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <string>
+
+#include <gst/gst.h>
+
+#include "gst_utils.h"
+
+namespace player {
+
+// Changes the playback rate of a running file pipeline. Video-only files get
+// an instant rate change seek that applies the rate at the sink. scaletempo
+// only takes the rate from a new segment, so with audio a non-flushing seek
+// starts one where the demuxer has pushed up to: the queued buffers play out
+// at the old rate and audio keeps its pitch without a gap. A flushing seek
+// to the current position is the last resort. Late video is dropped by the
+// decoder and sink QoS. Decoded frames, CPU time and QoS drops are accounted
+// per rate.
+class PlaybackRate {
+ public:
+  static constexpr double kMin = 0.5;
+  static constexpr double kMax = 4.0;
+
+  // `segment` keeps the segment seeks of --loop going
+  PlaybackRate(GstElement *pipeline, bool segment);
+  ~PlaybackRate();
+
+  PlaybackRate(const PlaybackRate &other) = delete;
+  PlaybackRate &operator=(const PlaybackRate &) = delete;
+
+  // Clamped to [kMin, kMax]. Returns false if the pipeline refused the seek.
+  bool Set(double rate);
+  double Current() const { return rate; }
+
+  void OnQos(GstMessage *msg);
+
+  void LogSummary();
+
+ private:
+  // Stream time up to which the demuxer has pushed buffers into a queue.
+  struct Pushed {
+    GstPadPtr pad;
+    gulong probe = 0;
+    // only touched by the streaming thread
+    GstSegment segment;
+    std::atomic<GstClockTime> end = GST_CLOCK_TIME_NONE;
+  };
+
+  static GstPadProbeReturn CountDecoded(GstPad *pad, GstPadProbeInfo *info,
+                                        gpointer user_data);
+  static GstPadProbeReturn TrackPushed(GstPad *pad, GstPadProbeInfo *info,
+                                       gpointer user_data);
+
+  void Watch(Pushed &pushed, const char *queue);
+  // where a non-flushing seek continues without repeating queued buffers
+  GstClockTime NextBoundary() const;
+
+  // charges frames and CPU time since the last change to the current rate
+  void Account();
+
+  GstElement *pipeline;
+  bool segment;
+  double rate = 1.0;
+
+  // negotiated once the file has an audio stream
+  GstPadPtr tempo_pad;
+
+  Pushed pushed_video;
+  Pushed pushed_audio;
+
+  GstPadPtr decoder_pad;
+  gulong probe = 0;
+  std::atomic<uint64_t> decoded = 0;
+
+  struct Usage {
+    double wall_s = 0.0;
+    double cpu_s = 0.0;
+    uint64_t decoded = 0;
+    // QoS drops by element
+    std::map<std::string, uint64_t> dropped;
+  };
+  std::map<double, Usage> usage;
+
+  // last QoS counters by element, they are cumulative
+  std::map<std::string, uint64_t> last_dropped;
+
+  uint64_t last_decoded = 0;
+  uint64_t last_cpu_ns;
+  GstClockTime last_wall;
+};
+
+}  // namespace player
@@ -1,14 +1,48 @@
+#include <algorithm>
+#include <array>
 #include <cstring>
+#include <memory>
 #include <optional>
+#include <set>
+#include <vector>
 
 #include <gst/gst.h>
 #include <SDL3/SDL.h>
+#include <spdlog/fmt/fmt.h>
 #include <spdlog/spdlog.h>
 
+#include "clip_cache.h"
+#include "frame_scheduler.h"
+#include "glyph_atlas.h"
+#include "media_index.h"
+#include "options.h"
 #include "pipeline.h"
 #include "sdl_utils.h"
+#include "software_renderer.h"
+#include "subtitles.h"
+#include "tracing.h"
+
+namespace {
+constexpr int kSubtitleHeight = 160;
+// steps of the [ and ] keys
+constexpr std::array kRates = {0.5, 0.75, 1.0, 1.25, 1.5, 2.0, 3.0, 4.0};
+// left and right arrow keys
+constexpr GstClockTimeDiff kSeekStep = 10 * GST_SECOND;
+constexpr int kOsdWidth = 200;
+constexpr int kOsdHeight = 100;
+}  // namespace
 
 int main(int argc, char **argv) {
+  auto options = player::ParseOptions(&argc, &argv);
+  if (not options) {
+    return -1;
+  }
+
+  if (options->build_index) {
+    gst_init(&argc, &argv);
+    return player::BuildIndexes(options->inputs, options->index_dir) ? 0 : -1;
+  }
+
   auto sdl = player::InitSDL();
   if (not sdl) {
     return -1;
@@ -19,78 +53,362 @@ int main(int argc, char **argv) {
     return -1;
   }
 
+  // the spectrum goes below the frame time histogram
+  int osd_height = options->spectrum ? 2 * kOsdHeight : kOsdHeight;
   auto w2 =
-      player::InitPopupWindow(w1->window.get(), 100, 100,
+      player::InitPopupWindow(w1->window.get(), kOsdWidth, osd_height,
                               SDL_WINDOW_POPUP_MENU | SDL_WINDOW_TRANSPARENT |
                                   SDL_WINDOW_NOT_FOCUSABLE | SDL_WINDOW_HIDDEN);
   if (not w2) {
     return -1;
   }
 
+  auto w3 = player::InitPopupWindow(
+      w1->window.get(), 1024, kSubtitleHeight,
+      SDL_WINDOW_TOOLTIP | SDL_WINDOW_TRANSPARENT | SDL_WINDOW_NOT_FOCUSABLE |
+          SDL_WINDOW_HIDDEN);
+  if (not w3) {
+    return -1;
+  }
+  SDL_SetWindowPosition(w3->window.get(), 0, 768 - kSubtitleHeight);
+
   // if (!SDL_SetWindowParent(w2->window.get(), w1->window.get())) {
   //   spdlog::error("Error setting parent window! {}", SDL_GetError());
   // }
 
+  // mirrors of the main window, each one gets its own video sink
+  std::vector<player::SDLWindowContext> mirrors;
+  for (int i = 1; i < options->outputs; i++) {
+    auto title = fmt::format("Player {}", i + 1);
+    auto mirror =
+        player::InitWindow(title.c_str(), 1024, 768, SDL_WINDOW_RESIZABLE);
+    if (not mirror) {
+      return -1;
+    }
+    mirrors.push_back(std::move(*mirror));
+  }
+
   void *display = nullptr;
-  void *surface = nullptr;
+  std::vector<player::VideoOutput> outputs;
+
+  auto wayland_surface = [&sdl](SDL_Window *window) -> void * {
+    if (sdl->wm != "wayland") {
+      return nullptr;
+    }
+    return SDL_GetPointerProperty(SDL_GetWindowProperties(window),
+                                  SDL_PROP_WINDOW_WAYLAND_SURFACE_POINTER,
+                                  NULL);
+  };
 
   if (sdl->wm == "wayland") {
     display =
         SDL_GetPointerProperty(SDL_GetWindowProperties(w1->window.get()),
                                SDL_PROP_WINDOW_WAYLAND_DISPLAY_POINTER, NULL);
-    surface =
-        SDL_GetPointerProperty(SDL_GetWindowProperties(w1->window.get()),
-                               SDL_PROP_WINDOW_WAYLAND_SURFACE_POINTER, NULL);
+  }
+  outputs.push_back({wayland_surface(w1->window.get()), 1024, 768});
+  for (auto &mirror : mirrors) {
+    outputs.push_back({wayland_surface(mirror.window.get()), 1024, 768});
+  }
+
+  if (!options->trace_path.empty()) {
+    player::tracing::ConfigureTracers();
   }
 
   gst_init(&argc, &argv);
 
-  player::VideoPipeline pipe(
-      "/home/tom/Downloads/bourne_ultimatum_trailer/video.mp4", display,
-      surface);
+  std::optional<player::utils::DestructorCallback> trace;
+  if (!options->trace_path.empty()) {
+    trace = player::tracing::Start(options->trace_path);
+  }
 
-  pipe.Play();
+  // shared by every playlist item, outlives the pipelines playing from it
+  std::optional<player::ClipCache> clips;
+  if (options->clip_cache_mb > 0) {
+    clips.emplace(static_cast<guint64>(options->clip_cache_mb) << 20);
+  }
 
-  bool done = false;
-  while (!done) {
-    SDL_Event event;
-    while (SDL_PollEvent(&event) > 0) {
-      if (event.type == SDL_EVENT_QUIT) {
-        done = true;
+  // video is only decoded at full rate while one of these is visible
+  std::vector<SDL_WindowID> video_windows{SDL_GetWindowID(w1->window.get())};
+  for (auto &mirror : mirrors) {
+    video_windows.push_back(SDL_GetWindowID(mirror.window.get()));
+  }
+  std::set<SDL_WindowID> hidden_windows;
+
+  // every playlist item gets its own pipeline showing in the same windows,
+  // the previous one is torn down first to release the sinks, so pipe is
+  // null until an item opens
+  std::unique_ptr<player::VideoPipeline> pipe;
+  // outlives items that fail to open
+  bool muted = false;
+  auto open = [&](size_t index) {
+    auto item_options = *options;
+    item_options.input = options->inputs[index];
+    if (pipe) {
+      muted = pipe->Muted();
+    }
+    pipe.reset();
+    try {
+      pipe = std::make_unique<player::VideoPipeline>(
+          item_options, display, outputs, clips ? &*clips : nullptr);
+    } catch (const player::PipelineError &e) {
+      spdlog::error("{}: {}", item_options.input, e.what());
+      return false;
+    }
+    spdlog::info("[playlist] {}/{} {}", index + 1, options->inputs.size(),
+                 item_options.input);
+    pipe->SetMuted(muted);
+    pipe->SetVisible(hidden_windows.size() < video_windows.size());
+    pipe->Play();
+    return true;
+  };
+  // skips items that can't be played, false once there's nothing left
+  size_t item = 0;
+  auto advance = [&]() {
+    for (size_t tried = 0; tried < options->inputs.size(); tried++) {
+      if (++item == options->inputs.size()) {
+        if (!options->loop_playlist) {
+          return false;
+        }
+        item = 0;
       }
-      if (event.type == SDL_EVENT_WINDOW_CLOSE_REQUESTED &&
-          event.window.windowID == SDL_GetWindowID(w1->window.get())) {
-        done = true;
+      if (open(item)) {
+        return true;
       }
-      if (event.type == SDL_EVENT_WINDOW_RESIZED &&
-          event.window.windowID == SDL_GetWindowID(w1->window.get())) {
-        pipe.Resize(event.window.data1, event.window.data2);
+    }
+    return false;
+  };
+
+  if (!open(item) && !advance()) {
+    return -1;
+  }
+
+  player::FrameScheduler scheduler(w1->window.get());
+  auto main_surface = scheduler.AddSurface("w1", w1->renderer.get());
+  auto osd_surface = scheduler.AddSurface("w2", w2->renderer.get());
+  auto subtitle_surface = scheduler.AddSurface("w3", w3->renderer.get());
+  std::vector<int> mirror_surfaces;
+  for (size_t i = 0; i < mirrors.size(); i++) {
+    mirror_surfaces.push_back(scheduler.AddSurface(
+        fmt::format("mirror{}", i + 1), mirrors[i].renderer.get()));
+  }
+
+  std::optional<player::SubtitleRenderer> subtitles;
+  if (auto atlas =
+          player::GlyphAtlas::Create(w3->renderer.get(), options->subtitle_font,
+                                     options->subtitle_size)) {
+    subtitles.emplace(std::move(*atlas));
+  }
+  std::optional<player::SoftwareRenderer> software;
+  if (options->software) {
+    software.emplace(w1->renderer.get());
+  }
+  bool redraw_video = false;
+
+  bool redraw_subtitles = false;
+  bool subtitles_visible = false;
 
-        // SDL_SetWindow
+  auto snapshot_interval_ns =
+      static_cast<Uint64>(options->snapshot_interval * SDL_NS_PER_SECOND);
+  Uint64 next_snapshot_ns = SDL_GetTicksNS() + snapshot_interval_ns;
+
+  // the OSD only changes when the statistics are redrawn, the spectrum needs
+  // a steady frame rate to look alive
+  Uint64 osd_interval_ns =
+      pipe->Spectrum() ? 33 * SDL_NS_PER_MS : 500 * SDL_NS_PER_MS;
+  Uint64 next_osd_ns = 0;
+  bool osd_visible = false;
+
+  bool done = false;
+  while (!done) {
+    {
+      player::tracing::Span span{"PollEvents"};
+      SDL_Event event;
+      while (SDL_PollEvent(&event) > 0) {
+        if (event.type == SDL_EVENT_QUIT) {
+          done = true;
+        }
+        if (event.type == SDL_EVENT_WINDOW_CLOSE_REQUESTED &&
+            event.window.windowID == SDL_GetWindowID(w1->window.get())) {
+          done = true;
+        }
+        if (event.type == SDL_EVENT_WINDOW_RESIZED &&
+            event.window.windowID == SDL_GetWindowID(w1->window.get())) {
+          player::tracing::Span span{"Resize"};
+          // later playlist items start at the current size
+          outputs[0].width = event.window.data1;
+          outputs[0].height = event.window.data2;
+          pipe->Resize(0, event.window.data1, event.window.data2);
+          scheduler.Invalidate(main_surface);
+          redraw_video = software.has_value();
+
+          SDL_SetWindowSize(w3->window.get(), event.window.data1,
+                            kSubtitleHeight);
+          SDL_SetWindowPosition(w3->window.get(), 0,
+                                event.window.data2 - kSubtitleHeight);
+          redraw_subtitles = true;
+
+          // SDL_SetWindow
+        }
+        if (event.type == SDL_EVENT_WINDOW_RESIZED) {
+          for (size_t i = 0; i < mirrors.size(); i++) {
+            if (event.window.windowID ==
+                SDL_GetWindowID(mirrors[i].window.get())) {
+              outputs[i + 1].width = event.window.data1;
+              outputs[i + 1].height = event.window.data2;
+              pipe->Resize(i + 1, event.window.data1, event.window.data2);
+              scheduler.Invalidate(mirror_surfaces[i]);
+            }
+          }
+        }
+        if (event.type == SDL_EVENT_WINDOW_DISPLAY_CHANGED &&
+            event.window.windowID == SDL_GetWindowID(w1->window.get())) {
+          scheduler.UpdateRefreshRate(w1->window.get());
+        }
+        if (std::find(video_windows.begin(), video_windows.end(),
+                      event.window.windowID) != video_windows.end()) {
+          switch (event.type) {
+            case SDL_EVENT_WINDOW_MINIMIZED:
+            case SDL_EVENT_WINDOW_HIDDEN:
+            case SDL_EVENT_WINDOW_OCCLUDED:
+              hidden_windows.insert(event.window.windowID);
+              pipe->SetVisible(hidden_windows.size() < video_windows.size());
+              break;
+            case SDL_EVENT_WINDOW_RESTORED:
+            case SDL_EVENT_WINDOW_SHOWN:
+            case SDL_EVENT_WINDOW_EXPOSED:
+              hidden_windows.erase(event.window.windowID);
+              pipe->SetVisible(true);
+              break;
+          }
+        }
+        if (event.type == SDL_EVENT_KEY_UP && event.key.key == SDLK_M) {
+          pipe->SetMuted(!pipe->Muted());
+        }
+        if (event.type == SDL_EVENT_KEY_UP &&
+            (event.key.key == SDLK_LEFTBRACKET ||
+             event.key.key == SDLK_RIGHTBRACKET)) {
+          auto step = std::find_if(
+              kRates.begin(), kRates.end(),
+              [rate = pipe->Rate()](double r) { return r >= rate; });
+          if (event.key.key == SDLK_LEFTBRACKET && step != kRates.begin()) {
+            step--;
+          } else if (event.key.key == SDLK_RIGHTBRACKET &&
+                     step + 1 != kRates.end()) {
+            step++;
+          }
+          pipe->SetRate(*step);
+        }
+        if (event.type == SDL_EVENT_KEY_UP && event.key.key == SDLK_BACKSLASH) {
+          pipe->SetRate(1.0);
+        }
+        if (event.type == SDL_EVENT_KEY_UP &&
+            (event.key.key == SDLK_LEFT || event.key.key == SDLK_RIGHT)) {
+          pipe->SeekBy(event.key.key == SDLK_LEFT ? -kSeekStep : kSeekStep);
+        }
+        if (event.type == SDL_EVENT_KEY_UP && event.key.key == SDLK_R) {
+          pipe->Replay(options->replay_seconds * GST_SECOND);
+        }
+        if (event.type == SDL_EVENT_MOUSE_BUTTON_UP) {
+          if (event.button.button == SDL_BUTTON_RIGHT) {
+            pipe->Pause();
+          }
+          if (event.button.button == SDL_BUTTON_LEFT) {
+            pipe->Play();
+          }
+        }
       }
-      if (event.type == SDL_EVENT_MOUSE_BUTTON_UP) {
-        if (event.button.button == SDL_BUTTON_RIGHT) {
-          pipe.Pause();
+    }
+
+    {
+      player::tracing::Span span{"ProcessMessages"};
+      if (pipe->ProcessMessages()) {
+        // an item recovery gave up on is skipped like one that ended
+        if (!pipe->AtEnd()) {
+          spdlog::warn("[playlist] giving up on item {}", item + 1);
+        }
+        // the old pipeline is already gone when no item could be opened
+        if (!advance()) {
+          break;
         }
-        if (event.button.button == SDL_BUTTON_LEFT) {
-          pipe.Play();
+        // running times start over with the next file
+        if (subtitles) {
+          subtitles->Clear();
         }
       }
     }
 
-    if (pipe.ProcessMessages()) {
-      done = true;
+    if (software) {
+      if (auto frame = pipe->PullVideoFrame()) {
+        redraw_video |= software->Update(frame.get());
+      }
+    }
+
+    if (redraw_video) {
+      int width, height;
+      SDL_GetWindowSize(w1->window.get(), &width, &height);
+      SDL_SetRenderDrawColor(w1->renderer.get(), 0, 0, 0, 255);
+      SDL_RenderClear(w1->renderer.get());
+      software->Draw(SDL_FRect{0.f, 0.f, static_cast<float>(width),
+                               static_cast<float>(height)});
+      scheduler.Invalidate(main_surface);
+      redraw_video = false;
+    }
+
+    if (!options->snapshot_dir.empty() &&
+        SDL_GetTicksNS() >= next_snapshot_ns) {
+      player::tracing::Span span{"Snapshot"};
+      pipe->Snapshot();
+      next_snapshot_ns += snapshot_interval_ns;
+    }
+
+    if (subtitles) {
+      if (pipe->SubtitlesFlushed()) {
+        subtitles->Clear();
+      }
+      if (auto subtitle = pipe->PullSubtitle()) {
+        subtitles->Show(*subtitle);
+      }
+      redraw_subtitles |= subtitles->Update(pipe->RunningTime());
+    }
+
+    if (redraw_subtitles && subtitles) {
+      int width, height;
+      SDL_GetWindowSize(w3->window.get(), &width, &height);
+      SDL_SetRenderDrawColor(w3->renderer.get(), 0, 0, 0, 0);
+      SDL_RenderClear(w3->renderer.get());
+      subtitles->Draw(w3->renderer.get(),
+                      SDL_FRect{0.f, 0.f, static_cast<float>(width),
+                                static_cast<float>(height)});
+      scheduler.Invalidate(subtitle_surface);
+      redraw_subtitles = false;
     }
 
-    SDL_RenderPresent(w1->renderer.get());
+    if (SDL_GetTicksNS() >= next_osd_ns) {
+      SDL_SetRenderDrawColor(w2->renderer.get(), 0, 0, 0, 0);
+      SDL_RenderClear(w2->renderer.get());
+      player::DrawFrameTimes(w2->renderer.get(), scheduler,
+                             SDL_FRect{0.f, 0.f, kOsdWidth, kOsdHeight});
+      if (auto *spectrum = pipe->Spectrum()) {
+        player::DrawSpectrum(w2->renderer.get(), spectrum->Current(),
+                             SDL_FRect{0.f, kOsdHeight, kOsdWidth, kOsdHeight});
+      }
+      scheduler.Invalidate(osd_surface);
+      next_osd_ns = SDL_GetTicksNS() + osd_interval_ns;
+    }
 
-    SDL_SetRenderDrawColor(w2->renderer.get(), 128, 172, 62, 128);
-    auto rect = SDL_FRect{0.f, 0.f, 100.f, 100.f};
-    SDL_RenderFillRect(w2->renderer.get(), &rect);
-    SDL_RenderPresent(w2->renderer.get());
+    scheduler.Present();
 
-    SDL_ShowWindow(w2->window.get());
+    if (!osd_visible) {
+      SDL_ShowWindow(w2->window.get());
+      osd_visible = true;
+    }
+    if (!subtitles_visible && subtitles) {
+      SDL_ShowWindow(w3->window.get());
+      subtitles_visible = true;
+    }
   }
 
+  scheduler.LogSummary();
+
   return 0;
 }
@@ -10,10 +10,20 @@
  * freely.
  */
 
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <memory>
+#include <optional>
+
 #include <SDL3/SDL.h>
 #include <SDL3/SDL_main.h>
+#include <gst/gst.h>
 
+#include "histogram.h"
 #include "icon.h"
+#include "options.h"
+#include "pipeline.h"
 #include <wayland-client.h>
 
 #include <xdg-shell-client-protocol.h>
@@ -31,6 +41,13 @@ static SDL_FRect velocities[NUM_SPRITES];
 static int sprite_w, sprite_h;
 static int done;
 
+/* Frame intervals of both layers, the video one is written by the sink's
+ * streaming thread */
+static player::utils::Histogram sprite_frame_ms(0.5, 200);
+static player::utils::Histogram video_frame_ms(0.5, 200);
+static Uint64 last_present_ns;
+static Uint64 last_video_ns;
+
 static SDL_Texture *CreateTexture(SDL_Renderer *r, unsigned char *data,
                                   unsigned int len, int *w, int *h) {
   SDL_Texture *texture = NULL;
@@ -61,8 +78,8 @@ static void MoveSprites(void) {
   /* Get the window size */
   SDL_GetWindowSizeInPixels(window, &window_w, &window_h);
 
-  /* Draw a gray background */
-  SDL_SetRenderDrawColor(renderer, 0xA0, 0xA0, 0xA0, 0xFF);
+  /* Clear to transparent, the video layer shows through */
+  SDL_SetRenderDrawColor(renderer, 0, 0, 0, 0);
   SDL_RenderClear(renderer);
 
   /* Move the sprite, bounce at the wall, and draw */
@@ -86,6 +103,24 @@ static void MoveSprites(void) {
 
   /* Update the screen! */
   SDL_RenderPresent(renderer);
+
+  Uint64 now = SDL_GetTicksNS();
+  if (last_present_ns) {
+    sprite_frame_ms.Add((now - last_present_ns) / 1e6);
+  }
+  last_present_ns = now;
+}
+
+/* The sink blocks until each frame is due, so buffers arrive at the rate the
+ * video layer is updated */
+static GstPadProbeReturn MeasureVideoFrame(GstPad *pad, GstPadProbeInfo *info,
+                                           gpointer user_data) {
+  Uint64 now = SDL_GetTicksNS();
+  if (last_video_ns) {
+    video_frame_ms.Add((now - last_video_ns) / 1e6);
+  }
+  last_video_ns = now;
+  return GST_PAD_PROBE_OK;
 }
 
 static int InitSprites(void) {
@@ -126,6 +161,15 @@ static struct _state {
   struct xdg_wm_base *xdg_wm_base;
   struct xdg_surface *xdg_surface;
   struct xdg_toplevel *xdg_toplevel;
+  struct wl_compositor *wl_compositor;
+  struct wl_subcompositor *wl_subcompositor;
+  struct wl_shm *wl_shm;
+
+  /* The video layer, a subsurface below the SDL surface that waylandsink
+   * renders into */
+  struct wl_surface *video_surface;
+  struct wl_subsurface *video_subsurface;
+  struct wl_buffer *video_placeholder;
 } state;
 
 static void xdg_surface_configure(void *data, struct xdg_surface *xdg_surface,
@@ -182,6 +226,15 @@ static void registry_global(void *data, struct wl_registry *wl_registry,
     state.xdg_wm_base = (struct xdg_wm_base*)
         wl_registry_bind(state.wl_registry, name, &xdg_wm_base_interface, 1);
     xdg_wm_base_add_listener(state.xdg_wm_base, &xdg_wm_base_listener, NULL);
+  } else if (SDL_strcmp(interface, wl_compositor_interface.name) == 0) {
+    state.wl_compositor = (struct wl_compositor*)
+        wl_registry_bind(state.wl_registry, name, &wl_compositor_interface, 4);
+  } else if (SDL_strcmp(interface, wl_subcompositor_interface.name) == 0) {
+    state.wl_subcompositor = (struct wl_subcompositor*)wl_registry_bind(
+        state.wl_registry, name, &wl_subcompositor_interface, 1);
+  } else if (SDL_strcmp(interface, wl_shm_interface.name) == 0) {
+    state.wl_shm = (struct wl_shm*)
+        wl_registry_bind(state.wl_registry, name, &wl_shm_interface, 1);
   }
 }
 
@@ -195,9 +248,73 @@ static const struct wl_registry_listener wl_registry_listener = {
     .global_remove = registry_global_remove,
 };
 
+/* A surface needs a buffer to be mapped, a single transparent pixel is
+ * enough: waylandsink's own subsurfaces inside it are sized by the render
+ * rectangle, not by their parent */
+static struct wl_buffer *CreatePlaceholderBuffer(void) {
+  int fd = memfd_create("player2-placeholder", MFD_CLOEXEC);
+  if (fd < 0) {
+    return NULL;
+  }
+  if (ftruncate(fd, 4) != 0) {
+    close(fd);
+    return NULL;
+  }
+  struct wl_shm_pool *pool = wl_shm_create_pool(state.wl_shm, fd, 4);
+  struct wl_buffer *buffer =
+      wl_shm_pool_create_buffer(pool, 0, 1, 1, 4, WL_SHM_FORMAT_ARGB8888);
+  wl_shm_pool_destroy(pool);
+  close(fd);
+  return buffer;
+}
+
+static int InitVideoLayer(void) {
+  if (!state.wl_compositor || !state.wl_subcompositor || !state.wl_shm) {
+    SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                 "wl_compositor, wl_subcompositor or wl_shm not found!");
+    return -1;
+  }
+
+  state.video_surface = wl_compositor_create_surface(state.wl_compositor);
+  state.video_subsurface = wl_subcompositor_get_subsurface(
+      state.wl_subcompositor, state.video_surface, state.wl_surface);
+  /* Takes effect with the next commit of the SDL surface */
+  wl_subsurface_place_below(state.video_subsurface, state.wl_surface);
+  wl_subsurface_set_position(state.video_subsurface, 0, 0);
+  /* Video frames are shown when they are due, not when sprites are drawn */
+  wl_subsurface_set_desync(state.video_subsurface);
+
+  /* Input goes to the sprite layer */
+  struct wl_region *region = wl_compositor_create_region(state.wl_compositor);
+  wl_surface_set_input_region(state.video_surface, region);
+  wl_region_destroy(region);
+
+  state.video_placeholder = CreatePlaceholderBuffer();
+  if (!state.video_placeholder) {
+    SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                 "Failed to create the video placeholder buffer");
+    return -1;
+  }
+  wl_surface_attach(state.video_surface, state.video_placeholder, 0, 0);
+  wl_surface_commit(state.video_surface);
+  return 0;
+}
+
 int main(int argc, char **argv) {
   int ret = -1;
   SDL_PropertiesID props;
+  std::optional<player::Options> options;
+  std::unique_ptr<player::VideoPipeline> pipe;
+  player::GstPadPtr video_pad;
+
+  options = player::ParseOptions(&argc, &argv);
+  if (!options) {
+    return -1;
+  }
+  /* One wayland output, the sprite layer is drawn by SDL */
+  options->outputs = 1;
+  options->software = false;
+  gst_init(&argc, &argv);
 
   if (!SDL_Init(SDL_INIT_VIDEO | SDL_INIT_EVENTS)) {
     return -1;
@@ -217,6 +334,8 @@ int main(int argc, char **argv) {
       true); /* Roleless surface */
   SDL_SetBooleanProperty(props, SDL_PROP_WINDOW_CREATE_OPENGL_BOOLEAN,
                          true); /* OpenGL enabled */
+  SDL_SetBooleanProperty(props, SDL_PROP_WINDOW_CREATE_TRANSPARENT_BOOLEAN,
+                         true); /* Video shows through */
   SDL_SetNumberProperty(props, SDL_PROP_WINDOW_CREATE_WIDTH_NUMBER,
                         WINDOW_WIDTH); /* Default width */
   SDL_SetNumberProperty(props, SDL_PROP_WINDOW_CREATE_HEIGHT_NUMBER,
@@ -240,6 +359,8 @@ int main(int argc, char **argv) {
     SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Renderer creation failed");
     goto exit;
   }
+  /* Sprites update at the display rate, independent of the video */
+  SDL_SetRenderVSync(renderer, 1);
 
   /* Get the display object and use it to create a registry object, which will
    * enumerate the xdg_wm_base protocol. */
@@ -279,13 +400,37 @@ int main(int argc, char **argv) {
     goto exit;
   }
 
+  if (InitVideoLayer() < 0) {
+    goto exit;
+  }
+
   wl_surface_commit(state.wl_surface);
   wl_display_dispatch(state.wl_display);
 
+  try {
+    int w, h;
+    SDL_GetWindowSize(window, &w, &h);
+    pipe = std::make_unique<player::VideoPipeline>(
+        *options, state.wl_display,
+        std::vector<player::VideoOutput>{{state.video_surface, w, h}});
+  } catch (const player::PipelineError &e) {
+    SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "%s", e.what());
+    goto exit;
+  }
+  video_pad = pipe->SinkPad(0);
+  if (video_pad) {
+    gst_pad_add_probe(video_pad.get(), GST_PAD_PROBE_TYPE_BUFFER,
+                      MeasureVideoFrame, NULL, NULL);
+  }
+  pipe->Play();
+
   while (!done) {
 
     SDL_Event event;
     while (SDL_PollEvent(&event)) {
+      if (event.type == SDL_EVENT_WINDOW_RESIZED) {
+        pipe->Resize(0, event.window.data1, event.window.data2);
+      }
       if (event.type == SDL_EVENT_KEY_DOWN) {
         switch (event.key.key) {
           case SDLK_ESCAPE:
@@ -313,6 +458,10 @@ int main(int argc, char **argv) {
       }
     }
 
+    if (pipe->ProcessMessages()) {
+      done = 1;
+    }
+
     /* Draw the sprites */
     MoveSprites();
   }
@@ -320,6 +469,40 @@ int main(int argc, char **argv) {
   ret = 0;
 
 exit:
+  /* Stop the video before the surfaces it renders into go away */
+  pipe.reset();
+  video_pad.reset();
+  if (sprite_frame_ms.Count() > 0) {
+    SDL_Log("sprite layer frame ms: %s", sprite_frame_ms.Summary().c_str());
+  }
+  if (video_frame_ms.Count() > 0) {
+    SDL_Log("video layer frame ms: %s", video_frame_ms.Summary().c_str());
+  }
+
+  if (state.video_subsurface) {
+    wl_subsurface_destroy(state.video_subsurface);
+    state.video_subsurface = NULL;
+  }
+  if (state.video_surface) {
+    wl_surface_destroy(state.video_surface);
+    state.video_surface = NULL;
+  }
+  if (state.video_placeholder) {
+    wl_buffer_destroy(state.video_placeholder);
+    state.video_placeholder = NULL;
+  }
+  if (state.wl_shm) {
+    wl_shm_destroy(state.wl_shm);
+    state.wl_shm = NULL;
+  }
+  if (state.wl_subcompositor) {
+    wl_subcompositor_destroy(state.wl_subcompositor);
+    state.wl_subcompositor = NULL;
+  }
+  if (state.wl_compositor) {
+    wl_compositor_destroy(state.wl_compositor);
+    state.wl_compositor = NULL;
+  }
   /* The display and surface handles obtained from SDL are owned by SDL and must
    * *NOT* be destroyed here! */
   if (state.xdg_toplevel) {
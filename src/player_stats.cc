@@ -0,0 +1,141 @@
+// Prints the stats every running player publishes with --stats.
+//
+//   ./build/player_stats [-w] [PID...]
+//
+// Without PIDs every player found in /dev/shm is shown, -w repeats every
+// second.
+
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <spdlog/fmt/fmt.h>
+
+#include "stats_shm.h"
+
+namespace {
+
+constexpr const char *kShmDir = "/dev/shm";
+constexpr auto kWatchInterval = std::chrono::seconds{1};
+
+// GstState, without linking against GStreamer
+constexpr const char *kStateNames[] = {"VOID_PENDING", "NULL", "READY",
+                                       "PAUSED", "PLAYING"};
+
+const char *StateName(int32_t state) {
+  return state >= 0 && state < 5 ? kStateNames[state] : "?";
+}
+
+uint64_t MonotonicNs() {
+  timespec time;
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  return static_cast<uint64_t>(time.tv_sec) * 1000000000 + time.tv_nsec;
+}
+
+double Seconds(uint64_t ns) { return ns / 1e9; }
+double Ms(uint64_t ns) { return ns / 1e6; }
+
+std::vector<int> FindPlayers() {
+  std::vector<int> pids;
+  std::string_view prefix = player::kStatsShmPrefix + 1;
+  std::error_code error;
+  for (const auto &entry :
+       std::filesystem::directory_iterator{kShmDir, error}) {
+    auto name = entry.path().filename().string();
+    if (name.starts_with(prefix)) {
+      pids.push_back(std::atoi(name.c_str() + prefix.size()));
+    }
+  }
+  return pids;
+}
+
+bool Print(int pid) {
+  auto name = player::StatsShmName(pid);
+  int fd = shm_open(name.c_str(), O_RDONLY, 0);
+  if (fd < 0) {
+    fmt::print("{}: no stats ({})\n", pid, strerror(errno));
+    return false;
+  }
+  void *memory =
+      mmap(nullptr, sizeof(player::SharedStats), PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (memory == MAP_FAILED) {
+    fmt::print("{}: {}\n", pid, strerror(errno));
+    return false;
+  }
+
+  const auto *shared = static_cast<const player::SharedStats *>(memory);
+  player::StatsSnapshot s;
+  bool valid = shared->magic == player::kStatsMagic &&
+               shared->version == player::kStatsVersion;
+  if (!valid) {
+    fmt::print("{}: unknown layout\n", pid);
+  } else if (!player::ReadStats(shared, &s)) {
+    fmt::print("{}: writer too busy\n", pid);
+    valid = false;
+  }
+  munmap(memory, sizeof(player::SharedStats));
+  if (!valid) {
+    return false;
+  }
+
+  // a crashed player leaves its segment behind
+  bool alive = kill(pid, 0) == 0 || errno != ESRCH;
+  fmt::print("{}{}: {} {:.3f}/{:.3f} s at {:.2f}x, updated {:.0f} ms ago\n",
+             pid, alive ? "" : " (exited)", StateName(s.pipeline_state),
+             Seconds(s.position_ns), Seconds(s.duration_ns), s.rate,
+             Ms(MonotonicNs() - s.update_ns));
+  fmt::print("  video: {:.2f} fps, {} rendered, {} dropped, decoder {}\n",
+             s.fps, s.rendered, s.dropped, StateName(s.decoder_state));
+  fmt::print("  queues: video {} buffers {:.1f} KB {:.0f} ms, "
+             "audio {} buffers {:.1f} KB {:.0f} ms\n",
+             s.queue_video_buffers, s.queue_video_bytes / 1024.0,
+             Ms(s.queue_video_ns), s.queue_audio_buffers,
+             s.queue_audio_bytes / 1024.0, Ms(s.queue_audio_ns));
+  if (s.av_drift_ns != player::kUnknownDrift) {
+    fmt::print("  a/v drift: {:+.1f} ms\n", s.av_drift_ns / 1e6);
+  }
+  fmt::print("  errors {}, recoveries {}, warnings {}, qos {}, loops {}\n",
+             s.errors, s.recoveries, s.warnings, s.qos_messages, s.loops);
+  return true;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  bool watch = false;
+  std::vector<int> pids;
+  for (int i = 1; i < argc; i++) {
+    if (std::string_view{argv[i]} == "-w") {
+      watch = true;
+    } else {
+      pids.push_back(std::atoi(argv[i]));
+    }
+  }
+
+  while (true) {
+    auto players = pids.empty() ? FindPlayers() : pids;
+    if (players.empty()) {
+      fmt::print("no players publishing stats\n");
+    }
+    bool success = true;
+    for (int pid : players) {
+      success &= Print(pid);
+    }
+    if (!watch) {
+      return success ? 0 : 1;
+    }
+    std::this_thread::sleep_for(kWatchInterval);
+    fmt::print("\n");
+  }
+}
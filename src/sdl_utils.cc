@@ -1,6 +1,8 @@
 
 #include "sdl_utils.h"
 
+#include <algorithm>
+#include <array>
 #include <cstring>
 #include <optional>
 
@@ -101,4 +103,28 @@ std::optional<SDLWindowContext> InitPopupWindow(SDL_Window* parent, int width,
   return SDLWindowContext{std::move(window), std::move(renderer)};
 }
 
+void DrawSpectrum(SDL_Renderer* renderer, const AudioSpectrum::Levels& levels,
+                  const SDL_FRect& area) {
+  constexpr float kMeterWidth = 6.f;
+  constexpr float kGap = 1.f;
+
+  float left = area.x + kMeterWidth + kGap;
+  float bar_width = (area.x + area.w - left) / AudioSpectrum::kBands;
+
+  std::array<SDL_FRect, AudioSpectrum::kBands> bars;
+  for (size_t i = 0; i < bars.size(); i++) {
+    float height = area.h * levels.bands[i];
+    bars[i] = SDL_FRect{left + i * bar_width, area.y + area.h - height,
+                        std::max(bar_width - kGap, 1.f), height};
+  }
+
+  SDL_SetRenderDrawColor(renderer, 62, 140, 200, 200);
+  SDL_RenderFillRects(renderer, bars.data(), static_cast<int>(bars.size()));
+
+  float meter = area.h * levels.rms;
+  auto rms = SDL_FRect{area.x, area.y + area.h - meter, kMeterWidth, meter};
+  SDL_SetRenderDrawColor(renderer, 230, 200, 60, 200);
+  SDL_RenderFillRect(renderer, &rms);
+}
+
 }  // namespace player
@@ -6,6 +6,7 @@
 
 #include <SDL3/SDL.h>
 
+#include "audio_spectrum.h"
 #include "utils.h"
 
 namespace player {
@@ -13,6 +14,8 @@ namespace player {
 using SDLWindowPtr = std::unique_ptr<SDL_Window, decltype(&SDL_DestroyWindow)>;
 using SDLRendererPtr =
     std::unique_ptr<SDL_Renderer, decltype(&SDL_DestroyRenderer)>;
+using SDLTexturePtr =
+    std::unique_ptr<SDL_Texture, decltype(&SDL_DestroyTexture)>;
 
 struct SDLContext {
   utils::DestructorCallback sdl_quit;
@@ -33,4 +36,8 @@ std::optional<SDLWindowContext> InitPopupWindow(SDL_Window* parent, int width,
                                                 int height,
                                                 SDL_WindowFlags flags);
 
+// Draws the bands as one batch of bars and the RMS level along the left edge.
+void DrawSpectrum(SDL_Renderer* renderer, const AudioSpectrum::Levels& levels,
+                  const SDL_FRect& area);
+
 }  // namespace player
@@ -0,0 +1,153 @@
+#include "segment_loop.h"
+
+#include <cmath>
+
+#include <gst/gst.h>
+#include <spdlog/spdlog.h>
+
+#include "tracing.h"
+
+namespace player {
+namespace {
+
+// 0.1 ms buckets up to 100 ms, a seamless loop is well below one frame
+constexpr double kBucketMs = 0.1;
+constexpr size_t kBuckets = 1000;
+
+double ToMs(GstClockTimeDiff time) { return static_cast<double>(time) / 1e6; }
+
+}  // namespace
+
+SegmentLoop::SegmentLoop(GstElement *pipeline, GstPad *sink_pad)
+    : pipeline(pipeline),
+      sink_pad(GstPadPtr{GST_PAD(gst_object_ref(sink_pad))}),
+      gap_ms(kBucketMs, kBuckets),
+      late_ms(kBucketMs, kBuckets),
+      restart_ms(kBucketMs, kBuckets) {
+  gst_segment_init(&segment, GST_FORMAT_UNDEFINED);
+  probe = gst_pad_add_probe(
+      sink_pad,
+      static_cast<GstPadProbeType>(GST_PAD_PROBE_TYPE_BUFFER |
+                                   GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM),
+      Measure, this, nullptr);
+}
+
+SegmentLoop::~SegmentLoop() {
+  gst_pad_remove_probe(sink_pad.get(), probe);
+  LogSummary();
+}
+
+void SegmentLoop::LogSummary() const {
+  spdlog::info("[loop] {} iterations", iterations);
+  spdlog::info("[loop] boundary gap ms: {}", gap_ms.Summary());
+  spdlog::info("[loop] first frame late ms: {}", late_ms.Summary());
+  spdlog::info("[loop] segment done to first frame ms: {}",
+               restart_ms.Summary());
+}
+
+GstClockTime SegmentLoop::Now() {
+  auto clock = GstClockPtr{gst_element_get_clock(pipeline)};
+  if (!clock) {
+    return GST_CLOCK_TIME_NONE;
+  }
+  return gst_clock_get_time(clock.get()) - gst_element_get_base_time(pipeline);
+}
+
+bool SegmentLoop::Seek(GstSeekFlags flags) {
+  if (!gst_element_seek(pipeline, rate, GST_FORMAT_TIME, flags,
+                        GST_SEEK_TYPE_SET, 0, GST_SEEK_TYPE_NONE,
+                        GST_CLOCK_TIME_NONE)) {
+    spdlog::error("[loop] segment seek failed");
+    return false;
+  }
+  return true;
+}
+
+void SegmentLoop::Start() {
+  if (started) {
+    return;
+  }
+  started = true;
+
+  // the flush is only paid once, before the first frame is shown
+  Seek(static_cast<GstSeekFlags>(GST_SEEK_FLAG_FLUSH | GST_SEEK_FLAG_SEGMENT));
+}
+
+void SegmentLoop::Restart() {
+  tracing::Instant("loop");
+  iterations++;
+  restart_time = Now();
+
+  // without a flush the new segment is queued behind the tail of the current
+  // one and its running time continues where the last frame ended
+  Seek(GST_SEEK_FLAG_SEGMENT);
+}
+
+GstPadProbeReturn SegmentLoop::Measure(GstPad *pad, GstPadProbeInfo *info,
+                                       gpointer user_data) {
+  auto *loop = static_cast<SegmentLoop *>(user_data);
+
+  if (GST_PAD_PROBE_INFO_TYPE(info) & GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM) {
+    auto *event = GST_PAD_PROBE_INFO_EVENT(info);
+    if (GST_EVENT_TYPE(event) == GST_EVENT_SEGMENT) {
+      const GstSegment *segment;
+      gst_event_parse_segment(event, &segment);
+      gst_segment_copy_into(segment, &loop->segment);
+
+      GstClockTime restart = loop->restart_time.exchange(GST_CLOCK_TIME_NONE);
+      if (GST_CLOCK_TIME_IS_VALID(restart)) {
+        loop->boundary = true;
+        loop->boundary_restart = restart;
+      }
+    } else if (GST_EVENT_TYPE(event) == GST_EVENT_FLUSH_STOP) {
+      loop->last_end = GST_CLOCK_TIME_NONE;
+    }
+    return GST_PAD_PROBE_OK;
+  }
+
+  auto *buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+  if (!GST_BUFFER_PTS_IS_VALID(buffer) ||
+      loop->segment.format != GST_FORMAT_TIME) {
+    return GST_PAD_PROBE_OK;
+  }
+
+  auto start = gst_segment_to_running_time(&loop->segment, GST_FORMAT_TIME,
+                                           GST_BUFFER_PTS(buffer));
+  if (!GST_CLOCK_TIME_IS_VALID(start)) {
+    return GST_PAD_PROBE_OK;
+  }
+
+  if (loop->boundary) {
+    loop->boundary = false;
+
+    auto now = loop->Now();
+    double gap = GST_CLOCK_TIME_IS_VALID(loop->last_end)
+                     ? ToMs(GST_CLOCK_DIFF(loop->last_end, start))
+                     : 0.0;
+    double late = GST_CLOCK_TIME_IS_VALID(now) && now > start
+                      ? ToMs(GST_CLOCK_DIFF(start, now))
+                      : 0.0;
+    double restart = GST_CLOCK_TIME_IS_VALID(now)
+                         ? ToMs(GST_CLOCK_DIFF(loop->boundary_restart, now))
+                         : 0.0;
+
+    // a negative gap means the frames overlap, which is just as visible
+    loop->gap_ms.Add(std::abs(gap));
+    loop->late_ms.Add(late);
+    loop->restart_ms.Add(restart);
+    tracing::Counter("loop gap ms", gap);
+
+    spdlog::info("[loop] boundary gap {:.2f} ms, first frame late {:.2f} ms, "
+                 "{:.2f} ms after segment done",
+                 gap, late, restart);
+  }
+
+  loop->last_end = start;
+  if (GST_BUFFER_DURATION_IS_VALID(buffer)) {
+    loop->last_end += GST_BUFFER_DURATION(buffer);
+  }
+
+  return GST_PAD_PROBE_OK;
+}
+
+}  // namespace player
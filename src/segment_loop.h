@@ -0,0 +1,63 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+#include <gst/gst.h>
+
+#include "gst_utils.h"
+#include "histogram.h"
+
+namespace player {
+
+// Loops a file pipeline with segment seeks. The initial flushing seek starts
+// a segment, every SEGMENT_DONE is answered with a non-flushing seek back to
+// the start, so the pipeline never changes state and no element is
+// re-created. A probe on the video sink measures each loop boundary: the gap
+// in running time between the last frame and the first frame of the next
+// iteration, and how late that first frame reaches the sink.
+class SegmentLoop {
+ public:
+  SegmentLoop(GstElement *pipeline, GstPad *sink_pad);
+  ~SegmentLoop();
+
+  SegmentLoop(const SegmentLoop &other) = delete;
+  SegmentLoop &operator=(const SegmentLoop &) = delete;
+
+  // Call once the pipeline has prerolled (ASYNC_DONE).
+  void Start();
+  // Call on SEGMENT_DONE.
+  void Restart();
+  // The rate every following iteration plays at.
+  void SetRate(double rate) { this->rate = rate; }
+
+  void LogSummary() const;
+
+ private:
+  static GstPadProbeReturn Measure(GstPad *pad, GstPadProbeInfo *info,
+                                   gpointer user_data);
+
+  bool Seek(GstSeekFlags flags);
+  GstClockTime Now();
+
+  GstElement *pipeline;
+  GstPadPtr sink_pad;
+  gulong probe = 0;
+  bool started = false;
+  double rate = 1.0;
+  uint64_t iterations = 0;
+
+  // set by Restart, consumed by the streaming thread at the next segment
+  std::atomic<GstClockTime> restart_time = GST_CLOCK_TIME_NONE;
+
+  // written by the sink streaming thread only
+  GstSegment segment;
+  bool boundary = false;
+  GstClockTime boundary_restart = GST_CLOCK_TIME_NONE;
+  GstClockTime last_end = GST_CLOCK_TIME_NONE;
+  utils::Histogram gap_ms;
+  utils::Histogram late_ms;
+  utils::Histogram restart_ms;
+};
+
+}  // namespace player
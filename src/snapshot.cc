@@ -0,0 +1,156 @@
+#include "snapshot.h"
+
+#include <atomic>
+#include <fstream>
+#include <mutex>
+#include <string>
+
+#include <gst/gst.h>
+#include <gst/video/video.h>
+#include <spdlog/fmt/fmt.h>
+#include <spdlog/spdlog.h>
+
+namespace player {
+namespace {
+
+constexpr GstClockTime kEncodeTimeout = 5 * GST_SECOND;
+constexpr uint64_t kLogEvery = 10;
+
+std::atomic<uint64_t> next_index = 0;
+
+// the base name without extension, anything unsafe in a file name replaced
+std::string SnapshotName(const std::string &input) {
+  auto base = GlibCharPtr{g_path_get_basename(input.c_str())};
+  std::string name = base.get();
+  if (auto dot = name.rfind('.'); dot != std::string::npos && dot > 0) {
+    name.resize(dot);
+  }
+  for (auto &c : name) {
+    if (!g_ascii_isalnum(c) && c != '-' && c != '_') {
+      c = '_';
+    }
+  }
+  return name.empty() ? "snapshot" : name;
+}
+
+}  // namespace
+
+SnapshotWorker::SnapshotWorker(std::string directory, std::string format,
+                               size_t max_queue, const std::string &input)
+    : directory(std::move(directory)),
+      format(std::move(format)),
+      name(SnapshotName(input)),
+      caps(GstCapsPtr{gst_caps_new_empty_simple(
+                          ("image/" + this->format).c_str()),
+                      &gst_caps_unref}),
+      max_queue(max_queue),
+      queue_depth(1.0, max_queue + 1),
+      encode_ms(10.0, 500),
+      thread(&SnapshotWorker::Run, this) {
+  g_mkdir_with_parents(this->directory.c_str(), 0755);
+  spdlog::info("[snapshot] writing {} to {}, queue of {}", this->format,
+               this->directory, max_queue);
+}
+
+SnapshotWorker::~SnapshotWorker() {
+  {
+    std::lock_guard lock{mutex};
+    stop = true;
+    dropped += queue.size();
+    queue.clear();
+  }
+  cv.notify_one();
+  thread.join();
+
+  LogStats();
+}
+
+bool SnapshotWorker::Submit(GstSamplePtr sample) {
+  {
+    std::lock_guard lock{mutex};
+    submitted++;
+    queue_depth.Add(queue.size());
+    if (queue.size() >= max_queue) {
+      dropped++;
+      spdlog::warn("[snapshot] queue full, dropping snapshot");
+      return false;
+    }
+    queue.push_back(std::move(sample));
+  }
+  cv.notify_one();
+  return true;
+}
+
+void SnapshotWorker::Run() {
+  while (true) {
+    auto sample = GstSamplePtr{nullptr, &gst_sample_unref};
+    {
+      std::unique_lock lock{mutex};
+      cv.wait(lock, [this] { return stop || !queue.empty(); });
+      if (stop) {
+        return;
+      }
+      sample = std::move(queue.front());
+      queue.pop_front();
+    }
+
+    Encode(sample.get(), next_index++);
+
+    if (written > 0 && written % kLogEvery == 0) {
+      LogStats();
+    }
+  }
+}
+
+void SnapshotWorker::Encode(GstSample *sample, uint64_t index) {
+  auto start = gst_util_get_timestamp();
+
+  GError *error = nullptr;
+  auto encoded = GstSamplePtr{
+      gst_video_convert_sample(sample, caps.get(), kEncodeTimeout, &error),
+      &gst_sample_unref};
+  if (!encoded) {
+    auto err = GlibErrorPtr{error, &g_error_free};
+    spdlog::error("[snapshot] encoding failed: {}",
+                  err ? err->message : "unknown");
+    failed++;
+    return;
+  }
+
+  auto *buffer = gst_sample_get_buffer(encoded.get());
+  GstMapInfo map;
+  if (!gst_buffer_map(buffer, &map, GST_MAP_READ)) {
+    failed++;
+    return;
+  }
+
+  auto pts = GST_BUFFER_PTS(gst_sample_get_buffer(sample));
+  auto path = fmt::format(
+      "{}/{}-{:06}-{:.3f}s.{}", directory, name, index,
+      GST_CLOCK_TIME_IS_VALID(pts) ? static_cast<double>(pts) / GST_SECOND
+                                   : 0.0,
+      format == "jpeg" ? "jpg" : format);
+
+  std::ofstream file{path, std::ios::binary};
+  file.write(reinterpret_cast<const char *>(map.data), map.size);
+  gst_buffer_unmap(buffer, &map);
+
+  if (!file) {
+    spdlog::error("[snapshot] couldn't write {}", path);
+    failed++;
+    return;
+  }
+
+  written++;
+  encode_ms.Add((gst_util_get_timestamp() - start) / 1e6);
+}
+
+void SnapshotWorker::LogStats() {
+  std::lock_guard lock{mutex};
+  spdlog::info("[snapshot] submitted {}, written {}, dropped {}, failed {}",
+               submitted, written, dropped, failed);
+  spdlog::info("[snapshot] encode ms: {}", encode_ms.Summary());
+  spdlog::info("[snapshot] queue depth: {}", queue_depth.Summary());
+}
+
+}  // namespace player
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include <gst/gst.h>
+
+#include "gst_utils.h"
+#include "histogram.h"
+
+namespace player {
+
+// Converts and encodes samples on a worker thread. The queue is bounded:
+// every queued sample pins a buffer of the decoder's pool, so snapshots are
+// dropped instead of starving the decoder when encoding falls behind.
+class SnapshotWorker {
+ public:
+  // `format` is "png" or "jpeg". File names start with the base name of
+  // `input` and are numbered across every worker of the process, playlist
+  // items don't overwrite each other's snapshots.
+  SnapshotWorker(std::string directory, std::string format, size_t max_queue,
+                 const std::string &input);
+  ~SnapshotWorker();
+
+  SnapshotWorker(const SnapshotWorker &other) = delete;
+  SnapshotWorker &operator=(const SnapshotWorker &) = delete;
+
+  // Returns false if the queue is full and the snapshot was dropped.
+  bool Submit(GstSamplePtr sample);
+
+ private:
+  void Run();
+  void Encode(GstSample *sample, uint64_t index);
+  void LogStats();
+
+  std::string directory;
+  std::string format;
+  std::string name;
+  GstCapsPtr caps;
+  size_t max_queue;
+
+  std::mutex mutex;
+  std::condition_variable cv;
+  std::deque<GstSamplePtr> queue;
+  bool stop = false;
+
+  // guarded by mutex
+  uint64_t submitted = 0;
+  uint64_t dropped = 0;
+  utils::Histogram queue_depth;
+
+  // worker thread only
+  uint64_t written = 0;
+  uint64_t failed = 0;
+  utils::Histogram encode_ms;
+
+  std::thread thread;
+};
+
+}  // namespace player
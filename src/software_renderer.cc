@@ -0,0 +1,124 @@
+#include "software_renderer.h"
+
+#include <algorithm>
+
+#include <gst/gst.h>
+#include <gst/video/video.h>
+#include <spdlog/spdlog.h>
+
+#include "tracing.h"
+
+namespace player {
+namespace {
+
+constexpr Uint64 kLogIntervalNs = 10 * SDL_NS_PER_SECOND;
+
+// 0.1 ms buckets up to 50 ms
+constexpr double kBucketMs = 0.1;
+constexpr size_t kBuckets = 500;
+
+}  // namespace
+
+SoftwareRenderer::SoftwareRenderer(SDL_Renderer *renderer)
+    : renderer(renderer), convert_ms(kBucketMs, kBuckets) {
+  spdlog::info("[software] converting with {} on {} threads",
+               KernelName(converter.Kernel()), converter.Threads());
+}
+
+bool SoftwareRenderer::Update(GstSample *sample) {
+  tracing::Span span{"ConvertFrame"};
+
+  GstVideoInfo info;
+  if (!gst_video_info_from_caps(&info, gst_sample_get_caps(sample))) {
+    return false;
+  }
+
+  auto format = GST_VIDEO_INFO_FORMAT(&info);
+  if (format != GST_VIDEO_FORMAT_NV12 && format != GST_VIDEO_FORMAT_I420) {
+    spdlog::error("[software] unsupported format {}",
+                  gst_video_format_to_string(format));
+    return false;
+  }
+
+  GstVideoFrame frame;
+  if (!gst_video_frame_map(&frame, &info, gst_sample_get_buffer(sample),
+                           GST_MAP_READ)) {
+    return false;
+  }
+
+  if (!texture || width != GST_VIDEO_INFO_WIDTH(&info) ||
+      height != GST_VIDEO_INFO_HEIGHT(&info)) {
+    width = GST_VIDEO_INFO_WIDTH(&info);
+    height = GST_VIDEO_INFO_HEIGHT(&info);
+    texture = SDLTexturePtr{
+        SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA32,
+                          SDL_TEXTUREACCESS_STREAMING, width, height),
+        &SDL_DestroyTexture};
+    if (!texture) {
+      spdlog::error("Error creating SDL_Texture! {}", SDL_GetError());
+      gst_video_frame_unmap(&frame);
+      return false;
+    }
+  }
+
+  YuvImage src{format == GST_VIDEO_FORMAT_NV12 ? YuvFormat::kNv12
+                                               : YuvFormat::kI420,
+               width, height};
+  for (guint plane = 0; plane < GST_VIDEO_FRAME_N_PLANES(&frame); plane++) {
+    src.planes[plane] =
+        static_cast<const uint8_t *>(GST_VIDEO_FRAME_PLANE_DATA(&frame, plane));
+    src.strides[plane] = GST_VIDEO_FRAME_PLANE_STRIDE(&frame, plane);
+  }
+
+  auto matrix = info.colorimetry.matrix == GST_VIDEO_COLOR_MATRIX_BT709
+                    ? YuvMatrix::kBt709
+                    : YuvMatrix::kBt601;
+  auto range = info.colorimetry.range == GST_VIDEO_COLOR_RANGE_0_255
+                   ? YuvRange::kFull
+                   : YuvRange::kLimited;
+
+  void *pixels;
+  int pitch;
+  auto start = SDL_GetTicksNS();
+  if (SDL_LockTexture(texture.get(), nullptr, &pixels, &pitch)) {
+    converter.Convert(src, {static_cast<uint8_t *>(pixels), pitch}, matrix,
+                      range);
+    SDL_UnlockTexture(texture.get());
+  }
+  gst_video_frame_unmap(&frame);
+
+  auto now = SDL_GetTicksNS();
+  convert_ms.Add(static_cast<double>(now - start) / SDL_NS_PER_MS);
+  if (now - last_log_ns >= kLogIntervalNs) {
+    LogStats();
+    last_log_ns = now;
+  }
+
+  return true;
+}
+
+void SoftwareRenderer::Draw(const SDL_FRect &area) {
+  if (!texture) {
+    return;
+  }
+
+  float scale = std::min(area.w / width, area.h / height);
+  auto target = SDL_FRect{area.x + (area.w - width * scale) / 2,
+                          area.y + (area.h - height * scale) / 2,
+                          width * scale, height * scale};
+  SDL_RenderTexture(renderer, texture.get(), nullptr, &target);
+}
+
+void SoftwareRenderer::LogStats() {
+  if (convert_ms.Count() == 0) {
+    return;
+  }
+  double mean_ms = convert_ms.Mean();
+  spdlog::info("[software] {}x{} {} x{}: convert ms: {}, {:.1f} Mpixel/s",
+               width, height, KernelName(converter.Kernel()),
+               converter.Threads(), convert_ms.Summary(),
+               mean_ms > 0 ? width * height / (mean_ms * 1e3) : 0.0);
+  convert_ms.Reset();
+}
+
+}  // namespace player
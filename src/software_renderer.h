@@ -0,0 +1,41 @@
+#pragma once
+
+#include <gst/gst.h>
+#include <SDL3/SDL.h>
+
+#include "histogram.h"
+#include "sdl_utils.h"
+#include "yuv_convert.h"
+
+namespace player {
+
+// Draws decoded frames with SDL when there is no wayland sink (X11, no GPU,
+// headless). Frames are converted straight into a streaming RGBA texture with
+// the SIMD converter, SDL's own YUV path is skipped.
+class SoftwareRenderer {
+ public:
+  explicit SoftwareRenderer(SDL_Renderer *renderer);
+
+  SoftwareRenderer(const SoftwareRenderer &other) = delete;
+  SoftwareRenderer &operator=(const SoftwareRenderer &) = delete;
+
+  // Returns false for anything but NV12 and I420 in system memory.
+  bool Update(GstSample *sample);
+
+  // Scales the last frame into `area`, keeping the aspect ratio.
+  void Draw(const SDL_FRect &area);
+
+ private:
+  void LogStats();
+
+  SDL_Renderer *renderer;
+  SDLTexturePtr texture{nullptr, &SDL_DestroyTexture};
+  int width = 0;
+  int height = 0;
+
+  YuvConverter converter;
+  utils::Histogram convert_ms;
+  Uint64 last_log_ns = 0;
+};
+
+}  // namespace player
@@ -0,0 +1,180 @@
+#include "stats_export.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <new>
+
+#include <gst/gst.h>
+#include <spdlog/spdlog.h>
+
+namespace player {
+namespace {
+
+uint64_t MonotonicNs() {
+  timespec time;
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  return static_cast<uint64_t>(time.tv_sec) * 1000000000 + time.tv_nsec;
+}
+
+GstElementPtr Find(GstElement *pipeline, const char *name) {
+  return GstElementPtr{gst_bin_get_by_name(GST_BIN(pipeline), name)};
+}
+
+int32_t CurrentState(GstElement *element) {
+  if (!element) {
+    return GST_STATE_VOID_PENDING;
+  }
+  GstState state = GST_STATE_VOID_PENDING;
+  gst_element_get_state(element, &state, nullptr, 0);
+  return state;
+}
+
+void ReadQueue(GstElement *queue, uint32_t *buffers, uint32_t *bytes,
+               uint64_t *ns) {
+  if (!queue) {
+    return;
+  }
+  guint level_buffers = 0;
+  guint level_bytes = 0;
+  guint64 level_time = 0;
+  g_object_get(queue, "current-level-buffers", &level_buffers,
+               "current-level-bytes", &level_bytes, "current-level-time",
+               &level_time, NULL);
+  *buffers = level_buffers;
+  *bytes = level_bytes;
+  *ns = level_time;
+}
+
+// Stream time of the frame the sink shows, from its last sample instead of a
+// position query, which only reads the pipeline clock.
+std::optional<GstClockTime> ShownFrameTime(GstElement *sink) {
+  GstSample *sample_raw = nullptr;
+  g_object_get(sink, "last-sample", &sample_raw, NULL);
+  auto sample = GstSamplePtr{sample_raw, &gst_sample_unref};
+  if (!sample) {
+    return {};
+  }
+  auto *buffer = gst_sample_get_buffer(sample.get());
+  auto *segment = gst_sample_get_segment(sample.get());
+  if (!buffer || !segment || !GST_BUFFER_PTS_IS_VALID(buffer)) {
+    return {};
+  }
+  auto time = gst_segment_to_stream_time(segment, GST_FORMAT_TIME,
+                                         GST_BUFFER_PTS(buffer));
+  if (!GST_CLOCK_TIME_IS_VALID(time)) {
+    return {};
+  }
+  return time;
+}
+
+}  // namespace
+
+void StatsExport::Unmap::operator()(SharedStats *stats) {
+  munmap(stats, sizeof(SharedStats));
+  shm_unlink(name.c_str());
+}
+
+std::optional<StatsExport> StatsExport::Create(GstElement *pipeline) {
+  auto name = StatsShmName(getpid());
+  int fd = shm_open(name.c_str(), O_CREAT | O_RDWR | O_TRUNC, 0644);
+  if (fd < 0) {
+    spdlog::error("[stats] shm_open {}: {}", name, strerror(errno));
+    return {};
+  }
+  if (ftruncate(fd, sizeof(SharedStats)) != 0) {
+    spdlog::error("[stats] ftruncate {}: {}", name, strerror(errno));
+    close(fd);
+    shm_unlink(name.c_str());
+    return {};
+  }
+  void *memory = mmap(nullptr, sizeof(SharedStats), PROT_READ | PROT_WRITE,
+                      MAP_SHARED, fd, 0);
+  close(fd);
+  if (memory == MAP_FAILED) {
+    spdlog::error("[stats] mmap {}: {}", name, strerror(errno));
+    shm_unlink(name.c_str());
+    return {};
+  }
+
+  auto *shared = new (memory) SharedStats{};
+  shared->version = kStatsVersion;
+  shared->pid = getpid();
+  WriteStats(shared, StatsSnapshot{});
+  // readers ignore the segment until the header is complete
+  std::atomic_thread_fence(std::memory_order_release);
+  shared->magic = kStatsMagic;
+
+  spdlog::info("[stats] publishing to /dev/shm{}", name);
+  return StatsExport{pipeline, SharedStatsPtr{shared, Unmap{name}}};
+}
+
+StatsExport::StatsExport(GstElement *pipeline, SharedStatsPtr shared)
+    : pipeline(pipeline),
+      shared(std::move(shared)),
+      sink_video(Find(pipeline, "sinkvideo")),
+      sink_audio(Find(pipeline, "sinkaudio")),
+      queue_video(Find(pipeline, "queuevideo")),
+      queue_audio(Find(pipeline, "queueaudio")),
+      decoder(Find(pipeline, "decodevideo")) {}
+
+void StatsExport::Publish(const StatsSnapshot &counters) {
+  auto snapshot = counters;
+  snapshot.update_ns = MonotonicNs();
+
+  gint64 position = 0;
+  gint64 duration = 0;
+  snapshot.position_ns =
+      gst_element_query_position(pipeline, GST_FORMAT_TIME, &position)
+          ? position
+          : 0;
+  snapshot.duration_ns =
+      gst_element_query_duration(pipeline, GST_FORMAT_TIME, &duration)
+          ? duration
+          : 0;
+
+  if (sink_video) {
+    // GstBaseSink keeps these anyway, reading them costs the sink nothing
+    GstStructure *stats = nullptr;
+    g_object_get(sink_video.get(), "stats", &stats, NULL);
+    if (auto structure = GstStructurePtr{stats, &gst_structure_free}) {
+      gst_structure_get_double(structure.get(), "average-rate",
+                               &snapshot.fps);
+      guint64 value;
+      if (gst_structure_get_uint64(structure.get(), "rendered", &value)) {
+        snapshot.rendered = value;
+      }
+      if (gst_structure_get_uint64(structure.get(), "dropped", &value)) {
+        snapshot.dropped = value;
+      }
+    }
+  }
+
+  ReadQueue(queue_video.get(), &snapshot.queue_video_buffers,
+            &snapshot.queue_video_bytes, &snapshot.queue_video_ns);
+  ReadQueue(queue_audio.get(), &snapshot.queue_audio_buffers,
+            &snapshot.queue_audio_bytes, &snapshot.queue_audio_ns);
+
+  // the audio sink's position follows what it has played out, the frame is
+  // shown until the next one so the drift reads up to a frame interval low
+  snapshot.av_drift_ns = kUnknownDrift;
+  gint64 audio_position;
+  if (sink_video && sink_audio &&
+      gst_element_query_position(sink_audio.get(), GST_FORMAT_TIME,
+                                 &audio_position)) {
+    if (auto video_time = ShownFrameTime(sink_video.get())) {
+      snapshot.av_drift_ns = static_cast<int64_t>(*video_time) - audio_position;
+    }
+  }
+
+  snapshot.pipeline_state = CurrentState(pipeline);
+  snapshot.decoder_state = CurrentState(decoder.get());
+
+  WriteStats(shared.get(), snapshot);
+}
+
+}  // namespace player
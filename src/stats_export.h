@@ -0,0 +1,46 @@
+#pragma once
+
+#include <memory>
+#include <optional>
+#include <string>
+
+#include <gst/gst.h>
+
+#include "gst_utils.h"
+#include "stats_shm.h"
+
+namespace player {
+
+// Publishes the player's stats to /dev/shm/player-stats-PID for external
+// monitoring (see player_stats). Pipeline stats are collected on the main
+// thread, writing them into the segment is a lock-free seqlock update.
+class StatsExport {
+ public:
+  // std::nullopt if the segment couldn't be created
+  static std::optional<StatsExport> Create(GstElement *pipeline);
+
+  // `counters` carries what's counted from bus messages, the rest is
+  // queried from the pipeline.
+  void Publish(const StatsSnapshot &counters);
+
+ private:
+  // unmaps and removes the segment
+  struct Unmap {
+    std::string name;
+    void operator()(SharedStats *stats);
+  };
+  using SharedStatsPtr = std::unique_ptr<SharedStats, Unmap>;
+
+  StatsExport(GstElement *pipeline, SharedStatsPtr shared);
+
+  GstElement *pipeline;
+  SharedStatsPtr shared;
+
+  GstElementPtr sink_video;
+  GstElementPtr sink_audio;
+  GstElementPtr queue_video;
+  GstElementPtr queue_audio;
+  GstElementPtr decoder;
+};
+
+}  // namespace player
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <type_traits>
+
+// Shared between the player, which publishes its stats into a POSIX shared
+// memory segment, and player_stats, which reads them. No GStreamer types, the
+// reader doesn't link against it.
+
+namespace player {
+
+constexpr const char *kStatsShmPrefix = "/player-stats-";
+constexpr uint32_t kStatsMagic = 0x504c5354;
+// bump on every layout change
+constexpr uint32_t kStatsVersion = 1;
+
+constexpr int64_t kUnknownDrift = INT64_MIN;
+
+// Everything that's published, copied in and out as a whole.
+struct StatsSnapshot {
+  // CLOCK_MONOTONIC
+  uint64_t update_ns;
+  uint64_t position_ns;
+  uint64_t duration_ns;
+  double rate;
+
+  // video sink
+  double fps;
+  uint64_t rendered;
+  uint64_t dropped;
+
+  uint32_t queue_video_buffers;
+  uint32_t queue_video_bytes;
+  uint64_t queue_video_ns;
+  uint32_t queue_audio_buffers;
+  uint32_t queue_audio_bytes;
+  uint64_t queue_audio_ns;
+
+  // stream time of the shown frame minus the audio sink's position,
+  // kUnknownDrift without audio or before the first frame
+  int64_t av_drift_ns;
+
+  // GstState
+  int32_t pipeline_state;
+  int32_t decoder_state;
+
+  // bus messages
+  uint64_t errors;
+  uint64_t warnings;
+  uint64_t qos_messages;
+  uint64_t loops;
+  uint64_t recoveries;
+};
+
+static_assert(std::is_trivially_copyable_v<StatsSnapshot>);
+static_assert(std::atomic<uint32_t>::is_always_lock_free);
+
+// The segment is a seqlock: the sequence is odd while the player writes, a
+// reader retries until it copied the snapshot between two reads of the same
+// even sequence. The writer never waits and never allocates.
+struct SharedStats {
+  uint32_t magic;
+  uint32_t version;
+  int32_t pid;
+  std::atomic<uint32_t> sequence;
+  StatsSnapshot snapshot;
+};
+
+inline std::string StatsShmName(int pid) {
+  return kStatsShmPrefix + std::to_string(pid);
+}
+
+inline void WriteStats(SharedStats *shared, const StatsSnapshot &snapshot) {
+  auto sequence = shared->sequence.load(std::memory_order_relaxed);
+  shared->sequence.store(sequence + 1, std::memory_order_relaxed);
+  // the odd sequence becomes visible before any of the payload
+  std::atomic_thread_fence(std::memory_order_release);
+  std::memcpy(&shared->snapshot, &snapshot, sizeof(snapshot));
+  shared->sequence.store(sequence + 2, std::memory_order_release);
+}
+
+// Returns false if every attempt overlapped a write.
+inline bool ReadStats(const SharedStats *shared, StatsSnapshot *snapshot,
+                      int attempts = 1000) {
+  for (int i = 0; i < attempts; i++) {
+    auto before = shared->sequence.load(std::memory_order_acquire);
+    if (before & 1) {
+      continue;
+    }
+    std::memcpy(snapshot, &shared->snapshot, sizeof(*snapshot));
+    // the payload is read before the sequence is checked again
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (shared->sequence.load(std::memory_order_relaxed) == before) {
+      return true;
+    }
+  }
+  return false;
+}
+
+}  // namespace player
@@ -0,0 +1,207 @@
+#include "subtitles.h"
+
+#include <algorithm>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <gst/gst.h>
+#include <SDL3/SDL.h>
+#include <spdlog/spdlog.h>
+
+namespace player {
+namespace {
+
+constexpr float kMargin = 8.f;
+constexpr float kShadowOffset = 2.f;
+
+constexpr SDL_FColor kTextColor = {1.f, 1.f, 1.f, 1.f};
+constexpr SDL_FColor kShadowColor = {0.f, 0.f, 0.f, 1.f};
+
+void AddQuad(std::vector<SDL_Vertex> &vertices, std::vector<int> &indices,
+             const SDL_FRect &dst, const SDL_FRect &uv,
+             const SDL_FColor &color) {
+  int base = static_cast<int>(vertices.size());
+
+  vertices.push_back({{dst.x, dst.y}, color, {uv.x, uv.y}});
+  vertices.push_back({{dst.x + dst.w, dst.y}, color, {uv.x + uv.w, uv.y}});
+  vertices.push_back(
+      {{dst.x + dst.w, dst.y + dst.h}, color, {uv.x + uv.w, uv.y + uv.h}});
+  vertices.push_back({{dst.x, dst.y + dst.h}, color, {uv.x, uv.y + uv.h}});
+
+  for (int i : {0, 1, 2, 0, 2, 3}) {
+    indices.push_back(base + i);
+  }
+}
+
+std::vector<std::string> SplitLines(const std::string &text) {
+  std::vector<std::string> lines;
+  size_t start = 0;
+  while (start <= text.size()) {
+    size_t end = text.find('\n', start);
+    if (end == std::string::npos) {
+      end = text.size();
+    }
+    lines.push_back(text.substr(start, end - start));
+    start = end + 1;
+  }
+  return lines;
+}
+
+}  // namespace
+
+SubtitleRenderer::SubtitleRenderer(GlyphAtlas atlas)
+    : atlas(std::move(atlas)) {}
+
+void SubtitleRenderer::Show(const Subtitle &subtitle) {
+  text = subtitle.markup ? StripMarkup(subtitle.text) : subtitle.text;
+  while (!text.empty() && (text.back() == '\n' || text.back() == '\r')) {
+    text.pop_back();
+  }
+  end = subtitle.end;
+  changed = true;
+  layout_valid = false;
+}
+
+void SubtitleRenderer::Clear() {
+  if (!text.empty()) {
+    text.clear();
+    changed = true;
+    layout_valid = false;
+  }
+  end = GST_CLOCK_TIME_NONE;
+}
+
+bool SubtitleRenderer::Update(GstClockTime running_time) {
+  if (!text.empty() && GST_CLOCK_TIME_IS_VALID(end) &&
+      GST_CLOCK_TIME_IS_VALID(running_time) && running_time >= end) {
+    text.clear();
+    changed = true;
+    layout_valid = false;
+  }
+
+  bool redraw = changed;
+  changed = false;
+  return redraw;
+}
+
+void SubtitleRenderer::Layout(const SDL_FRect &area) {
+  // a full atlas is cleared while rasterizing, the quads placed before
+  // point at glyphs that are gone; the second pass finds all of them
+  for (int pass = 0; pass < 2; pass++) {
+    auto generation = atlas.Generation();
+    LayoutOnce(area);
+    if (atlas.Generation() == generation) {
+      break;
+    }
+  }
+  layout_area = area;
+  layout_valid = true;
+}
+
+void SubtitleRenderer::LayoutOnce(const SDL_FRect &area) {
+  vertices.clear();
+  indices.clear();
+
+  auto lines = SplitLines(text);
+
+  std::vector<float> widths;
+  for (const auto &line : lines) {
+    float width = 0.f;
+    for (size_t pos = 0; pos < line.size();) {
+      if (const auto *glyph = atlas.Get(NextCodepoint(line, pos))) {
+        width += glyph->advance;
+      }
+    }
+    widths.push_back(width);
+  }
+
+  float line_height = atlas.LineHeight();
+  float text_width = *std::max_element(widths.begin(), widths.end());
+  float text_height = line_height * lines.size();
+  float top = area.y + area.h - text_height - kMargin;
+
+  background = SDL_FRect{area.x + (area.w - text_width) / 2 - kMargin,
+                         top - kMargin / 2, text_width + 2 * kMargin,
+                         text_height + kMargin};
+
+  // shadow first, the text quads are drawn over it in the same batch
+  for (auto [offset, color] : {std::pair{kShadowOffset, kShadowColor},
+                               std::pair{0.f, kTextColor}}) {
+    for (size_t i = 0; i < lines.size(); i++) {
+      float pen_x = area.x + (area.w - widths[i]) / 2 + offset;
+      float baseline = top + i * line_height + atlas.Ascender() + offset;
+
+      const auto &line = lines[i];
+      for (size_t pos = 0; pos < line.size();) {
+        const auto *glyph = atlas.Get(NextCodepoint(line, pos));
+        if (!glyph) {
+          continue;
+        }
+        if (glyph->rect.w > 0) {
+          auto dst = SDL_FRect{pen_x + glyph->bearing_x,
+                               baseline - glyph->bearing_y, glyph->rect.w,
+                               glyph->rect.h};
+          AddQuad(vertices, indices, dst, glyph->uv, color);
+        }
+        pen_x += glyph->advance;
+      }
+    }
+  }
+}
+
+void SubtitleRenderer::Draw(SDL_Renderer *renderer, const SDL_FRect &area) {
+  if (text.empty()) {
+    return;
+  }
+
+  if (!layout_valid || layout_area.w != area.w || layout_area.h != area.h) {
+    Layout(area);
+  }
+
+  SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_BLEND);
+  SDL_SetRenderDrawColor(renderer, 0, 0, 0, 96);
+  SDL_RenderFillRect(renderer, &background);
+
+  if (!SDL_RenderGeometry(renderer, atlas.Texture(), vertices.data(),
+                          static_cast<int>(vertices.size()), indices.data(),
+                          static_cast<int>(indices.size()))) {
+    spdlog::error("Error drawing subtitles! {}", SDL_GetError());
+  }
+}
+
+std::string StripMarkup(std::string_view markup) {
+  static constexpr std::pair<std::string_view, char> kEntities[] = {
+      {"&amp;", '&'},
+      {"&lt;", '<'},
+      {"&gt;", '>'},
+      {"&quot;", '"'},
+      {"&apos;", '\''}};
+
+  std::string text;
+  text.reserve(markup.size());
+
+  for (size_t i = 0; i < markup.size();) {
+    if (markup[i] == '<') {
+      auto close = markup.find('>', i);
+      i = close == std::string_view::npos ? markup.size() : close + 1;
+      continue;
+    }
+    if (markup[i] == '&') {
+      auto entity = std::find_if(
+          std::begin(kEntities), std::end(kEntities),
+          [&](const auto &e) { return markup.substr(i).starts_with(e.first); });
+      if (entity != std::end(kEntities)) {
+        text += entity->second;
+        i += entity->first.size();
+        continue;
+      }
+    }
+    text += markup[i++];
+  }
+
+  return text;
+}
+
+}  // namespace player
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <gst/gst.h>
+#include <SDL3/SDL.h>
+
+#include "glyph_atlas.h"
+#include "pipeline.h"
+
+namespace player {
+
+// Draws subtitles into an overlay window instead of burning them into the
+// video. A subtitle change costs one layout, every redraw is a single
+// SDL_RenderGeometry call on the glyph atlas.
+class SubtitleRenderer {
+ public:
+  explicit SubtitleRenderer(GlyphAtlas atlas);
+
+  void Show(const Subtitle &subtitle);
+  // Hides the current subtitle, e.g. after a seek or for a new file.
+  void Clear();
+
+  // Hides the subtitle once its end has passed. Returns true when the
+  // displayed text changed and the overlay has to be redrawn.
+  bool Update(GstClockTime running_time);
+
+  void Draw(SDL_Renderer *renderer, const SDL_FRect &area);
+
+ private:
+  void Layout(const SDL_FRect &area);
+  void LayoutOnce(const SDL_FRect &area);
+
+  GlyphAtlas atlas;
+
+  std::string text;
+  GstClockTime end = GST_CLOCK_TIME_NONE;
+  bool changed = false;
+
+  // layout of the current text, rebuilt when the text or the area changes
+  std::vector<SDL_Vertex> vertices;
+  std::vector<int> indices;
+  SDL_FRect background;
+  SDL_FRect layout_area;
+  bool layout_valid = false;
+};
+
+std::string StripMarkup(std::string_view markup);
+
+}  // namespace player
@@ -0,0 +1,233 @@
+#include "timeshift.h"
+
+#include <algorithm>
+
+#include <gst/gst.h>
+#include <spdlog/spdlog.h>
+
+#include "tracing.h"
+
+namespace player {
+namespace {
+
+double ToMB(guint64 bytes) { return bytes / (1024.0 * 1024.0); }
+
+GstClockTime Rebase(GstClockTime time, GstClockTime base) {
+  if (!GST_CLOCK_TIME_IS_VALID(time) || time < base) {
+    return GST_CLOCK_TIME_NONE;
+  }
+  return time - base;
+}
+
+}  // namespace
+
+Timeshift::Timeshift(GstPad *pad, guint64 max_bytes)
+    : pad(GstPadPtr{GST_PAD(gst_object_ref(pad))}), max_bytes(max_bytes) {
+  gst_segment_init(&segment, GST_FORMAT_UNDEFINED);
+  probe = gst_pad_add_probe(
+      pad,
+      static_cast<GstPadProbeType>(GST_PAD_PROBE_TYPE_BUFFER |
+                                   GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM),
+      Record, this, nullptr);
+  spdlog::info("[timeshift] ring of {:.1f} MB", ToMB(max_bytes));
+}
+
+Timeshift::~Timeshift() {
+  gst_pad_remove_probe(pad.get(), probe);
+  LogStats();
+}
+
+GstPadProbeReturn Timeshift::Record(GstPad *pad, GstPadProbeInfo *info,
+                                    gpointer user_data) {
+  auto *timeshift = static_cast<Timeshift *>(user_data);
+
+  if (GST_PAD_PROBE_INFO_TYPE(info) & GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM) {
+    auto *event = GST_PAD_PROBE_INFO_EVENT(info);
+    switch (GST_EVENT_TYPE(event)) {
+      case GST_EVENT_CAPS: {
+        GstCaps *caps;
+        gst_event_parse_caps(event, &caps);
+        bool changed;
+        {
+          std::lock_guard lock{timeshift->mutex};
+          changed = timeshift->caps &&
+                    !gst_caps_is_equal(timeshift->caps.get(), caps);
+          timeshift->caps = GstCapsPtr{gst_caps_ref(caps), &gst_caps_unref};
+        }
+        // buffers of the old caps can't be decoded with the new ones
+        if (changed) {
+          timeshift->Clear();
+        }
+        break;
+      }
+      case GST_EVENT_STREAM_START: {
+        timeshift->Clear();
+        break;
+      }
+      case GST_EVENT_SEGMENT: {
+        const GstSegment *segment;
+        gst_event_parse_segment(event, &segment);
+        gst_segment_copy_into(segment, &timeshift->segment);
+        break;
+      }
+      case GST_EVENT_FLUSH_STOP: {
+        // running time starts over after a flushing seek (SeekBy, rate
+        // changes, recovery), what was shown before stays replayable
+        timeshift->flushed = true;
+        break;
+      }
+      default:
+        break;
+    }
+    return GST_PAD_PROBE_OK;
+  }
+
+  auto *buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+  if (timeshift->segment.format != GST_FORMAT_TIME ||
+      !GST_BUFFER_PTS_IS_VALID(buffer)) {
+    return GST_PAD_PROBE_OK;
+  }
+
+  // running time stays monotonic across segment seeks (--loop)
+  auto pts = gst_segment_to_running_time(&timeshift->segment, GST_FORMAT_TIME,
+                                         GST_BUFFER_PTS(buffer));
+  auto dts = GST_BUFFER_DTS_IS_VALID(buffer)
+                 ? gst_segment_to_running_time(&timeshift->segment,
+                                               GST_FORMAT_TIME,
+                                               GST_BUFFER_DTS(buffer))
+                 : GST_CLOCK_TIME_NONE;
+  if (!GST_CLOCK_TIME_IS_VALID(pts)) {
+    return GST_PAD_PROBE_OK;
+  }
+
+  bool discont = false;
+  if (timeshift->flushed) {
+    // decoding can only resume at a keyframe
+    if (GST_BUFFER_FLAG_IS_SET(buffer, GST_BUFFER_FLAG_DELTA_UNIT)) {
+      return GST_PAD_PROBE_OK;
+    }
+    auto resume = GST_CLOCK_TIME_IS_VALID(dts) ? std::min(pts, dts) : pts;
+    timeshift->offset = timeshift->end > resume ? timeshift->end - resume : 0;
+    timeshift->flushed = false;
+    discont = true;
+  }
+
+  pts += timeshift->offset;
+  if (GST_CLOCK_TIME_IS_VALID(dts)) {
+    dts += timeshift->offset;
+  }
+  auto duration = GST_BUFFER_DURATION_IS_VALID(buffer)
+                      ? GST_BUFFER_DURATION(buffer)
+                      : 0;
+  timeshift->end = std::max(timeshift->end, pts + duration);
+  timeshift->Push(buffer, pts, dts, discont);
+
+  return GST_PAD_PROBE_OK;
+}
+
+void Timeshift::Push(GstBuffer *buffer, GstClockTime pts, GstClockTime dts,
+                     bool discont) {
+  bool keyframe = !GST_BUFFER_FLAG_IS_SET(buffer, GST_BUFFER_FLAG_DELTA_UNIT);
+
+  std::lock_guard lock{mutex};
+  if (keyframe) {
+    keyframes.push_back({pts, first_sequence + entries.size()});
+  }
+  entries.push_back({GstBufferPtr{gst_buffer_ref(buffer), &gst_buffer_unref},
+                     pts, dts, keyframe, discont});
+  bytes += gst_buffer_get_size(buffer);
+  peak_bytes = std::max(peak_bytes, bytes);
+
+  while (bytes > max_bytes && entries.size() > 1) {
+    PopFront();
+  }
+  // the rest of a partially evicted GOP can't be decoded
+  while (!entries.empty() && !entries.front().keyframe) {
+    PopFront();
+  }
+
+  tracing::Counter("timeshift MB", ToMB(bytes));
+}
+
+void Timeshift::PopFront() {
+  if (!keyframes.empty() && keyframes.front().sequence == first_sequence) {
+    keyframes.pop_front();
+  }
+  bytes -= gst_buffer_get_size(entries.front().buffer.get());
+  entries.pop_front();
+  first_sequence++;
+  evicted++;
+}
+
+void Timeshift::Clear() {
+  std::lock_guard lock{mutex};
+  first_sequence += entries.size();
+  entries.clear();
+  keyframes.clear();
+  bytes = 0;
+}
+
+std::optional<Timeshift::Clip> Timeshift::Extract(GstClockTime duration) {
+  std::lock_guard lock{mutex};
+  if (keyframes.empty() || !caps) {
+    return {};
+  }
+
+  // presentation order differs from decode order, look at the last GOP
+  GstClockTime latest = 0;
+  for (auto it = entries.begin() + (keyframes.back().sequence - first_sequence);
+       it != entries.end(); it++) {
+    latest = std::max(latest, it->pts);
+  }
+  auto target = latest > duration ? latest - duration : 0;
+
+  // nearest keyframe at or before the target, the oldest one otherwise
+  auto keyframe = std::upper_bound(
+      keyframes.begin(), keyframes.end(), target,
+      [](GstClockTime time, const Keyframe &key) { return time < key.pts; });
+  if (keyframe != keyframes.begin()) {
+    keyframe--;
+  }
+
+  auto first = entries.begin() + (keyframe->sequence - first_sequence);
+  auto base = first->pts;
+  if (GST_CLOCK_TIME_IS_VALID(first->dts)) {
+    base = std::min(base, first->dts);
+  }
+
+  Clip clip{GstCapsPtr{gst_caps_ref(caps.get()), &gst_caps_unref},
+            {},
+            latest - keyframe->pts,
+            target > keyframe->pts ? target - keyframe->pts : 0,
+            0};
+  clip.buffers.reserve(entries.end() - first);
+  for (auto it = first; it != entries.end(); it++) {
+    // shares the memory, only the metadata is copied
+    auto *buffer = gst_buffer_copy(it->buffer.get());
+    GST_BUFFER_PTS(buffer) = Rebase(it->pts, base);
+    GST_BUFFER_DTS(buffer) = Rebase(it->dts, base);
+    if (it->discont) {
+      GST_BUFFER_FLAG_SET(buffer, GST_BUFFER_FLAG_DISCONT);
+    }
+    clip.bytes += gst_buffer_get_size(buffer);
+    clip.buffers.emplace_back(buffer, &gst_buffer_unref);
+  }
+
+  return clip;
+}
+
+void Timeshift::LogStats() {
+  std::lock_guard lock{mutex};
+  GstClockTime span = 0;
+  if (entries.size() > 1) {
+    span = entries.back().pts - std::min(entries.back().pts,
+                                         entries.front().pts);
+  }
+  spdlog::info(
+      "[timeshift] {:.2f}/{:.2f} MB (peak {:.2f}), {} buffers, {} keyframes, "
+      "{:.1f} s, {} evicted",
+      ToMB(bytes), ToMB(max_bytes), ToMB(peak_bytes), entries.size(),
+      keyframes.size(), static_cast<double>(span) / GST_SECOND, evicted);
+}
+
+}  // namespace player
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+#include <gst/gst.h>
+
+#include "gst_utils.h"
+
+namespace player {
+
+// Keeps the most recent compressed video buffers in memory, bounded by bytes.
+// Buffers are referenced from a probe on the decoder's sink pad, nothing is
+// copied. Eviction works in whole GOPs so the ring always starts at a
+// keyframe, and keyframe positions are indexed by running time. Flushing
+// seeks restart running time, the ring keeps its buffers and continues its
+// own timeline after them with a discontinuity; only a new stream or caps
+// clear it.
+class Timeshift {
+ public:
+  // A replayable run of buffers starting at a keyframe, timestamps rebased to
+  // zero.
+  struct Clip {
+    GstCapsPtr caps;
+    std::vector<GstBufferPtr> buffers;
+    GstClockTime duration;
+    // how far before the requested start the keyframe was
+    GstClockTime preroll;
+    guint64 bytes;
+  };
+
+  Timeshift(GstPad *pad, guint64 max_bytes);
+  ~Timeshift();
+
+  Timeshift(const Timeshift &other) = delete;
+  Timeshift &operator=(const Timeshift &) = delete;
+
+  // The last `duration` of the stream, starting at the nearest keyframe at or
+  // before that point.
+  std::optional<Clip> Extract(GstClockTime duration);
+
+  void LogStats();
+
+ private:
+  struct Entry {
+    GstBufferPtr buffer;
+    GstClockTime pts;
+    GstClockTime dts;
+    bool keyframe;
+    // first buffer after a flush
+    bool discont;
+  };
+
+  struct Keyframe {
+    GstClockTime pts;
+    uint64_t sequence;
+  };
+
+  static GstPadProbeReturn Record(GstPad *pad, GstPadProbeInfo *info,
+                                  gpointer user_data);
+
+  void Push(GstBuffer *buffer, GstClockTime pts, GstClockTime dts,
+            bool discont);
+  void PopFront();
+  void Clear();
+
+  GstPadPtr pad;
+  gulong probe = 0;
+  guint64 max_bytes;
+
+  // only touched by the streaming thread
+  GstSegment segment;
+  // added to running time, keeps the timeline going across flushes
+  GstClockTime offset = 0;
+  // end of the last buffer on the ring's timeline
+  GstClockTime end = 0;
+  bool flushed = false;
+
+  std::mutex mutex;
+  GstCapsPtr caps{nullptr, &gst_caps_unref};
+  std::deque<Entry> entries;
+  std::deque<Keyframe> keyframes;
+  // sequence number of entries.front()
+  uint64_t first_sequence = 0;
+  guint64 bytes = 0;
+  guint64 peak_bytes = 0;
+  uint64_t evicted = 0;
+};
+
+}  // namespace player
@@ -0,0 +1,364 @@
+#include "tracing.h"
+
+#include <pthread.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include <gst/gst.h>
+#include <spdlog/fmt/fmt.h>
+#include <spdlog/spdlog.h>
+
+#include "gst_utils.h"
+
+namespace player::tracing {
+namespace {
+
+constexpr const char *kTracers = "latency(flags=pipeline+element);stats;rusage";
+constexpr const char *kTracerCategory = "GST_TRACER";
+
+// ~1M events is a few minutes of a busy pipeline, stop there rather than
+// growing without bounds
+constexpr size_t kMaxEvents = 1 << 20;
+
+struct Recorder {
+  GstClockTime origin;
+  int pid;
+
+  std::mutex mutex;
+  std::vector<std::string> events;
+  size_t dropped = 0;
+
+  // the stats tracer refers to elements and pads by index
+  std::unordered_map<guint, std::string> elements;
+  std::unordered_map<guint, std::string> pads;
+  // the rusage tracer names threads by their GThread, events by trace tid
+  std::unordered_map<guint64, int> threads;
+};
+
+std::atomic<Recorder *> active_recorder = nullptr;
+std::atomic<int> next_thread_id = 1;
+
+std::string Escape(std::string_view str) {
+  std::string out;
+  out.reserve(str.size());
+  for (char c : str) {
+    switch (c) {
+      case '"':
+        out += "\\\"";
+        break;
+      case '\\':
+        out += "\\\\";
+        break;
+      case '\n':
+        out += "\\n";
+        break;
+      default:
+        if (static_cast<unsigned char>(c) < 0x20) {
+          out += fmt::format("\\u{:04x}", static_cast<int>(c));
+        } else {
+          out += c;
+        }
+    }
+  }
+  return out;
+}
+
+double ToMicroseconds(const Recorder &recorder, GstClockTime timestamp) {
+  return static_cast<double>(timestamp - recorder.origin) / 1000.0;
+}
+
+void Push(Recorder &recorder, std::string event) {
+  std::lock_guard lock{recorder.mutex};
+  if (recorder.events.size() >= kMaxEvents) {
+    recorder.dropped++;
+    return;
+  }
+  recorder.events.push_back(std::move(event));
+}
+
+void PushThreadName(Recorder &recorder, int tid, std::string_view name) {
+  Push(recorder,
+       fmt::format(R"({{"name":"thread_name","ph":"M","pid":{},"tid":{},)"
+                   R"("args":{{"name":"{}"}}}})",
+                   recorder.pid, tid, Escape(name)));
+}
+
+int ThreadId(Recorder &recorder) {
+  thread_local int tid = 0;
+  if (tid == 0) {
+    auto gthread = static_cast<guint64>(
+        reinterpret_cast<guintptr>(g_thread_self()));
+    {
+      std::lock_guard lock{recorder.mutex};
+      auto [known, inserted] =
+          recorder.threads.emplace(gthread, next_thread_id.load());
+      if (inserted) {
+        next_thread_id++;
+      }
+      tid = known->second;
+    }
+
+    // GstTask names its threads after the owning pad, e.g. "queuevideo:src"
+    char name[16] = "unnamed";
+    pthread_getname_np(pthread_self(), name, sizeof(name));
+    PushThreadName(recorder, tid, name);
+  }
+  return tid;
+}
+
+// The trace tid of the thread with GThread `gthread`, which doesn't have to
+// be the calling one.
+int ThreadId(Recorder &recorder, guint64 gthread) {
+  int tid;
+  {
+    std::lock_guard lock{recorder.mutex};
+    auto [known, inserted] =
+        recorder.threads.emplace(gthread, next_thread_id.load());
+    if (!inserted) {
+      return known->second;
+    }
+    tid = next_thread_id++;
+  }
+  // named for real once the thread logs an event itself
+  PushThreadName(recorder, tid, fmt::format("thread {:#x}", gthread));
+  return tid;
+}
+
+void PushEvent(Recorder &recorder, std::string_view name, char phase,
+               double ts, std::string_view extra, int tid = 0) {
+  if (tid == 0) {
+    tid = ThreadId(recorder);
+  }
+  Push(recorder,
+       fmt::format(R"({{"name":"{}","ph":"{}","ts":{:.3f},"pid":{},)"
+                   R"("tid":{}{}}})",
+                   Escape(name), phase, ts, recorder.pid, tid, extra));
+}
+
+void PushCounter(Recorder &recorder, std::string_view name, double ts,
+                 std::string_view key, double value, int tid = 0) {
+  PushEvent(recorder, name, 'C', ts,
+            fmt::format(R"(,"args":{{"{}":{:.3f}}})", key, value), tid);
+}
+
+std::string GetString(const GstStructure *record, const char *field) {
+  if (const gchar *value = gst_structure_get_string(record, field)) {
+    return value;
+  }
+  return "?";
+}
+
+guint64 GetUint64(const GstStructure *record, const char *field) {
+  guint64 value = 0;
+  gst_structure_get_uint64(record, field, &value);
+  return value;
+}
+
+guint GetUint(const GstStructure *record, const char *field) {
+  guint value = 0;
+  gst_structure_get_uint(record, field, &value);
+  return value;
+}
+
+std::string Lookup(Recorder &recorder,
+                   const std::unordered_map<guint, std::string> &names,
+                   guint ix) {
+  std::lock_guard lock{recorder.mutex};
+  if (auto it = names.find(ix); it != names.end()) {
+    return it->second;
+  }
+  return fmt::format("#{}", ix);
+}
+
+void RememberObject(Recorder &recorder, const GstStructure *record,
+                    bool is_pad) {
+  auto ix = GetUint(record, "ix");
+  auto name = GetString(record, "name");
+
+  if (is_pad) {
+    auto parent =
+        Lookup(recorder, recorder.elements, GetUint(record, "parent-ix"));
+    std::lock_guard lock{recorder.mutex};
+    recorder.pads[ix] = parent + ":" + name;
+  } else {
+    std::lock_guard lock{recorder.mutex};
+    recorder.elements[ix] = std::move(name);
+  }
+}
+
+std::string SerializeFields(const GstStructure *record) {
+  std::string args;
+  gst_structure_foreach(
+      record,
+      [](GQuark field, const GValue *value, gpointer user_data) -> gboolean {
+        auto &args = *static_cast<std::string *>(user_data);
+        auto serialized = GlibCharPtr{gst_value_serialize(value)};
+        args += fmt::format(R"({}"{}":"{}")", args.empty() ? "" : ",",
+                            Escape(g_quark_to_string(field)),
+                            Escape(serialized ? serialized.get() : ""));
+        return TRUE;
+      },
+      &args);
+  return args;
+}
+
+void RecordTracerMessage(Recorder &recorder, const gchar *text) {
+  double ts = ToMicroseconds(recorder, gst_util_get_timestamp());
+
+  auto record = GstStructurePtr{gst_structure_from_string(text, nullptr),
+                                &gst_structure_free};
+  if (!record) {
+    return;
+  }
+
+  std::string_view type = gst_structure_get_name(record.get());
+
+  if (type == "new-element" || type == "new-pad") {
+    RememberObject(recorder, record.get(), type == "new-pad");
+  } else if (type == "buffer") {
+    auto pad = Lookup(recorder, recorder.pads, GetUint(record.get(), "pad-ix"));
+    auto pts = GetUint64(record.get(), "buffer-pts");
+    PushEvent(recorder, pad, 'i', ts,
+              fmt::format(R"(,"s":"t","args":{{"size":{},"pts_ms":{:.3f}}})",
+                          GetUint(record.get(), "buffer-size"),
+                          GST_CLOCK_TIME_IS_VALID(pts) ? pts / 1e6 : -1.0));
+  } else if (type == "latency") {
+    auto name = fmt::format("latency {}:{} -> {}:{}",
+                            GetString(record.get(), "src-element"),
+                            GetString(record.get(), "src"),
+                            GetString(record.get(), "sink-element"),
+                            GetString(record.get(), "sink"));
+    PushCounter(recorder, name, ts, "ms",
+                GetUint64(record.get(), "time") / 1e6);
+  } else if (type == "element-latency") {
+    auto name = fmt::format("latency {}:{}", GetString(record.get(), "element"),
+                            GetString(record.get(), "src"));
+    PushCounter(recorder, name, ts, "ms",
+                GetUint64(record.get(), "time") / 1e6);
+  } else if (type == "proc-rusage") {
+    // cpuload is reported in per mille
+    PushCounter(recorder, "cpuload", ts, "percent",
+                GetUint(record.get(), "current-cpuload") / 10.0);
+  } else if (type == "thread-rusage") {
+    // logged from whichever thread runs the tracer, not the measured one
+    auto tid = ThreadId(recorder, GetUint64(record.get(), "thread-id"));
+    auto name = fmt::format("cpuload tid {}", tid);
+    PushCounter(recorder, name, ts, "percent",
+                GetUint(record.get(), "current-cpuload") / 10.0, tid);
+  } else {
+    PushEvent(recorder, type, 'i', ts,
+              fmt::format(R"(,"s":"t","args":{{{}}})",
+                          SerializeFields(record.get())));
+  }
+}
+
+void LogFunction(GstDebugCategory *category, GstDebugLevel level,
+                 const gchar *file, const gchar *function, gint line,
+                 GObject *object, GstDebugMessage *message,
+                 gpointer user_data) {
+  if (std::string_view{gst_debug_category_get_name(category)} !=
+      kTracerCategory) {
+    gst_debug_log_default(category, level, file, function, line, object,
+                          message, nullptr);
+    return;
+  }
+
+  auto *recorder = static_cast<Recorder *>(user_data);
+  RecordTracerMessage(*recorder, gst_debug_message_get(message));
+}
+
+void Write(Recorder &recorder, const std::string &path) {
+  std::lock_guard lock{recorder.mutex};
+
+  std::ofstream file{path};
+  if (!file) {
+    spdlog::error("Couldn't open trace file: {}", path);
+    return;
+  }
+
+  file << "{\"traceEvents\":[\n";
+  for (size_t i = 0; i < recorder.events.size(); i++) {
+    file << (i == 0 ? "" : ",\n") << recorder.events[i];
+  }
+  file << "\n],\"displayTimeUnit\":\"ms\"}\n";
+
+  spdlog::info("Trace written to {}: {} events, {} dropped", path,
+               recorder.events.size(), recorder.dropped);
+}
+
+}  // namespace
+
+void ConfigureTracers() {
+  // don't override tracers explicitly requested by the user
+  g_setenv("GST_TRACERS", kTracers, FALSE);
+}
+
+utils::DestructorCallback Start(const std::string &path) {
+  auto recorder = std::make_shared<Recorder>();
+  recorder->origin = gst_util_get_timestamp();
+  recorder->pid = getpid();
+
+  // tracer records are logged at TRACE level, route them to the recorder
+  // and forward everything else to the default handler
+  gst_debug_set_active(TRUE);
+  gst_debug_set_threshold_for_name(kTracerCategory, GST_LEVEL_TRACE);
+  gst_debug_remove_log_function(gst_debug_log_default);
+  gst_debug_add_log_function(LogFunction, recorder.get(), nullptr);
+
+  active_recorder = recorder.get();
+  ThreadId(*recorder);
+
+  spdlog::info("Tracing to {}", path);
+
+  return utils::DestructorCallback([recorder, path] {
+    active_recorder = nullptr;
+
+    gst_debug_remove_log_function(LogFunction);
+    gst_debug_set_threshold_for_name(kTracerCategory, GST_LEVEL_NONE);
+    gst_debug_add_log_function(gst_debug_log_default, nullptr, nullptr);
+
+    Write(*recorder, path);
+  });
+}
+
+bool Enabled() { return active_recorder != nullptr; }
+
+Span::Span(const char *name)
+    : name(name), start(Enabled() ? gst_util_get_timestamp() : 0) {}
+
+Span::~Span() {
+  auto *recorder = active_recorder.load();
+  if (!recorder || start == 0) {
+    return;
+  }
+
+  auto end = gst_util_get_timestamp();
+  PushEvent(*recorder, name, 'X', ToMicroseconds(*recorder, start),
+            fmt::format(R"(,"dur":{:.3f})", (end - start) / 1000.0));
+}
+
+void Counter(const char *name, double value) {
+  if (auto *recorder = active_recorder.load()) {
+    PushCounter(*recorder, name,
+                ToMicroseconds(*recorder, gst_util_get_timestamp()), "value",
+                value);
+  }
+}
+
+void Instant(const char *name) {
+  if (auto *recorder = active_recorder.load()) {
+    PushEvent(*recorder, name, 'i',
+              ToMicroseconds(*recorder, gst_util_get_timestamp()),
+              R"(,"s":"t")");
+  }
+}
+
+}  // namespace player::tracing
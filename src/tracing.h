@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "utils.h"
+
+namespace player::tracing {
+
+// Asks GStreamer to load the latency, stats and rusage tracers. Has to be
+// called before gst_init, tracers are only instantiated during init.
+void ConfigureTracers();
+
+// Starts recording GstTracer records and application spans into a single
+// timeline. The trace is written to `path` in the Chrome trace event format
+// (loadable in chrome://tracing and ui.perfetto.dev) when the returned
+// callback goes out of scope.
+utils::DestructorCallback Start(const std::string &path);
+
+bool Enabled();
+
+// Records a complete event covering the lifetime of the object on the
+// calling thread. Costs a single atomic load when tracing is off.
+class Span {
+ public:
+  explicit Span(const char *name);
+  ~Span();
+
+  Span(const Span &other) = delete;
+  Span &operator=(const Span &) = delete;
+
+ private:
+  const char *name;
+  uint64_t start;
+};
+
+void Counter(const char *name, double value);
+
+void Instant(const char *name);
+
+}  // namespace player::tracing
@@ -0,0 +1,187 @@
+// Checks that every YUV->RGBA kernel matches the scalar reference pixel for
+// pixel and reports Mpixel/s for each kernel and for the threaded converter.
+//
+//   ./build/yuv_bench [WIDTH HEIGHT]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include <spdlog/spdlog.h>
+
+#include "yuv_convert.h"
+
+namespace {
+
+constexpr int kIterations = 50;
+constexpr size_t kThreads = 3;
+
+struct TestFrame {
+  std::vector<uint8_t> y;
+  std::vector<uint8_t> u;
+  std::vector<uint8_t> v;
+  player::YuvImage image;
+};
+
+TestFrame MakeFrame(player::YuvFormat format, int width, int height) {
+  std::mt19937 random{42};
+  std::uniform_int_distribution<int> byte{0, 255};
+  auto fill = [&](std::vector<uint8_t> &plane, size_t size) {
+    plane.resize(size);
+    for (auto &value : plane) {
+      value = static_cast<uint8_t>(byte(random));
+    }
+  };
+
+  int chroma_width = (width + 1) / 2;
+  int chroma_height = (height + 1) / 2;
+
+  TestFrame frame;
+  fill(frame.y, static_cast<size_t>(width) * height);
+  if (format == player::YuvFormat::kNv12) {
+    fill(frame.u, static_cast<size_t>(chroma_width) * 2 * chroma_height);
+    frame.image = {format,
+                   width,
+                   height,
+                   {frame.y.data(), frame.u.data(), nullptr},
+                   {width, chroma_width * 2, 0}};
+  } else {
+    fill(frame.u, static_cast<size_t>(chroma_width) * chroma_height);
+    fill(frame.v, static_cast<size_t>(chroma_width) * chroma_height);
+    frame.image = {format,
+                   width,
+                   height,
+                   {frame.y.data(), frame.u.data(), frame.v.data()},
+                   {width, chroma_width, chroma_width}};
+  }
+  return frame;
+}
+
+const char *FormatName(player::YuvFormat format) {
+  return format == player::YuvFormat::kNv12 ? "NV12" : "I420";
+}
+
+// Every kernel against the scalar reference, odd sizes cover the tails.
+bool CheckExact(int width, int height) {
+  bool exact = true;
+  for (auto format : {player::YuvFormat::kNv12, player::YuvFormat::kI420}) {
+    auto frame = MakeFrame(format, width, height);
+    std::vector<uint8_t> expected(static_cast<size_t>(width) * height * 4);
+    std::vector<uint8_t> actual(expected.size());
+
+    for (auto matrix : {player::YuvMatrix::kBt601, player::YuvMatrix::kBt709}) {
+      for (auto range : {player::YuvRange::kLimited, player::YuvRange::kFull}) {
+        player::ConvertRows(frame.image, {expected.data(), width * 4}, matrix,
+                            range, player::YuvKernel::kScalar, 0, height);
+
+        // the last pass checks the row bands of the threaded converter
+        auto kernels = player::AvailableKernels();
+        kernels.push_back(kernels.back());
+        for (size_t i = 0; i < kernels.size(); i++) {
+          auto kernel = kernels[i];
+          std::fill(actual.begin(), actual.end(), 0);
+          if (i + 1 < kernels.size()) {
+            player::ConvertRows(frame.image, {actual.data(), width * 4},
+                                matrix, range, kernel, 0, height);
+          } else {
+            player::YuvConverter converter{kThreads};
+            converter.Convert(frame.image, {actual.data(), width * 4}, matrix,
+                              range);
+          }
+          auto mismatch = std::mismatch(expected.begin(), expected.end(),
+                                        actual.begin());
+          if (mismatch.first != expected.end()) {
+            auto offset = mismatch.first - expected.begin();
+            spdlog::error("{} {}x{} matrix {} range {}: {} differs at pixel "
+                          "{} channel {} ({} != {})",
+                          FormatName(format), width, height,
+                          static_cast<int>(matrix), static_cast<int>(range),
+                          player::KernelName(kernel), offset / 4, offset % 4,
+                          *mismatch.second, *mismatch.first);
+            exact = false;
+          }
+        }
+      }
+    }
+  }
+  return exact;
+}
+
+template <typename Convert>
+double MegapixelsPerSecond(int width, int height, Convert convert) {
+  convert();  // warm up caches and worker threads
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < kIterations; i++) {
+    convert();
+  }
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  return static_cast<double>(width) * height * kIterations / 1e6 /
+         elapsed.count();
+}
+
+void Benchmark(int width, int height) {
+  for (auto format : {player::YuvFormat::kNv12, player::YuvFormat::kI420}) {
+    auto frame = MakeFrame(format, width, height);
+    std::vector<uint8_t> rgba(static_cast<size_t>(width) * height * 4);
+    player::RgbaImage dst{rgba.data(), width * 4};
+
+    double scalar = 0;
+    for (auto kernel : player::AvailableKernels()) {
+      auto rate = MegapixelsPerSecond(width, height, [&] {
+        player::ConvertRows(frame.image, dst, player::YuvMatrix::kBt709,
+                            player::YuvRange::kLimited, kernel, 0, height);
+      });
+      if (kernel == player::YuvKernel::kScalar) {
+        scalar = rate;
+      }
+      spdlog::info("{} {}x{} {:>8}: {:8.1f} Mpixel/s ({:.1f}x scalar)",
+                   FormatName(format), width, height,
+                   player::KernelName(kernel), rate, rate / scalar);
+    }
+
+    player::YuvConverter converter;
+    auto rate = MegapixelsPerSecond(width, height, [&] {
+      converter.Convert(frame.image, dst, player::YuvMatrix::kBt709,
+                        player::YuvRange::kLimited);
+    });
+    spdlog::info("{} {}x{} {:>8} x{}: {:8.1f} Mpixel/s ({:.1f}x scalar)",
+                 FormatName(format), width, height,
+                 player::KernelName(converter.Kernel()), converter.Threads(),
+                 rate, rate / scalar);
+  }
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  int width = 1920;
+  int height = 1080;
+  if (argc != 1 && argc != 3) {
+    spdlog::error("Usage: {} [WIDTH HEIGHT]", argv[0]);
+    return 1;
+  }
+  if (argc == 3) {
+    width = std::atoi(argv[1]);
+    height = std::atoi(argv[2]);
+  }
+  if (width <= 0 || height <= 0) {
+    spdlog::error("Invalid size {}x{}", width, height);
+    return 1;
+  }
+
+  // odd sizes run the SIMD tails and the last chroma row, clamped so small
+  // sizes still give a frame
+  int odd_width = std::max(1, width - 3);
+  int odd_height = std::max(1, height - 1);
+  if (!CheckExact(width, height) || !CheckExact(odd_width, odd_height)) {
+    return 1;
+  }
+  spdlog::info("All kernels match the scalar reference");
+
+  Benchmark(width, height);
+  return 0;
+}
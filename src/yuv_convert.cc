@@ -0,0 +1,424 @@
+#include "yuv_convert.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define PLAYER_X86 1
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define PLAYER_NEON 1
+#endif
+
+namespace player {
+namespace {
+
+constexpr int kShift = 16;
+constexpr int32_t kRound = 1 << (kShift - 1);
+constexpr size_t kMaxThreads = 4;
+
+struct Coefficients {
+  int32_t y_offset;
+  int32_t y;
+  int32_t vr;
+  int32_t ug;
+  int32_t vg;
+  int32_t ub;
+};
+
+Coefficients MakeCoefficients(YuvMatrix matrix, YuvRange range) {
+  double kr = matrix == YuvMatrix::kBt709 ? 0.2126 : 0.299;
+  double kb = matrix == YuvMatrix::kBt709 ? 0.0722 : 0.114;
+  double kg = 1.0 - kr - kb;
+
+  // limited range luma is 16..235 and chroma 16..240
+  bool limited = range == YuvRange::kLimited;
+  double y_scale = limited ? 255.0 / 219.0 : 1.0;
+  double c_scale = limited ? 255.0 / 224.0 : 1.0;
+
+  auto fixed = [](double value) {
+    return static_cast<int32_t>(std::lround(value * (1 << kShift)));
+  };
+  return Coefficients{limited ? 16 : 0,
+                      fixed(y_scale),
+                      fixed(2.0 * (1.0 - kr) * c_scale),
+                      fixed(2.0 * (1.0 - kb) * kb / kg * c_scale),
+                      fixed(2.0 * (1.0 - kr) * kr / kg * c_scale),
+                      fixed(2.0 * (1.0 - kb) * c_scale)};
+}
+
+uint8_t Clamp(int32_t value) {
+  return static_cast<uint8_t>(std::clamp(value, 0, 255));
+}
+
+// NV12 reads u and v from the same interleaved row with a step of 2
+struct ChromaRow {
+  const uint8_t *u;
+  const uint8_t *v;
+  int step;
+};
+
+void RowScalar(const uint8_t *y, const ChromaRow &chroma, uint8_t *dst,
+               int x, int width, const Coefficients &c) {
+  for (; x < width; x++) {
+    int32_t yy = (y[x] - c.y_offset) * c.y;
+    int32_t uu = chroma.u[(x / 2) * chroma.step] - 128;
+    int32_t vv = chroma.v[(x / 2) * chroma.step] - 128;
+    dst[4 * x + 0] = Clamp((yy + c.vr * vv + kRound) >> kShift);
+    dst[4 * x + 1] = Clamp((yy - c.ug * uu - c.vg * vv + kRound) >> kShift);
+    dst[4 * x + 2] = Clamp((yy + c.ub * uu + kRound) >> kShift);
+    dst[4 * x + 3] = 255;
+  }
+}
+
+template <typename T>
+T Load(const uint8_t *src) {
+  T value;
+  std::memcpy(&value, src, sizeof(value));
+  return value;
+}
+
+#if defined(PLAYER_X86)
+
+// 4 pixels per iteration, returns the first pixel left for the scalar tail
+__attribute__((target("sse4.1"))) int RowSse41(const uint8_t *y,
+                                               const ChromaRow &chroma,
+                                               uint8_t *dst, int width,
+                                               const Coefficients &c) {
+  const bool nv12 = chroma.step == 2;
+  const __m128i mask_u =
+      nv12 ? _mm_setr_epi8(0, -1, -1, -1, 0, -1, -1, -1, 2, -1, -1, -1, 2, -1,
+                           -1, -1)
+           : _mm_setr_epi8(0, -1, -1, -1, 0, -1, -1, -1, 1, -1, -1, -1, 1, -1,
+                           -1, -1);
+  const __m128i mask_v =
+      nv12 ? _mm_setr_epi8(1, -1, -1, -1, 1, -1, -1, -1, 3, -1, -1, -1, 3, -1,
+                           -1, -1)
+           : mask_u;
+  // packus leaves r0-3 g0-3 b0-3 a0-3
+  const __m128i to_rgba =
+      _mm_setr_epi8(0, 4, 8, 12, 1, 5, 9, 13, 2, 6, 10, 14, 3, 7, 11, 15);
+
+  const __m128i y_offset = _mm_set1_epi32(c.y_offset);
+  const __m128i bias = _mm_set1_epi32(128);
+  const __m128i round = _mm_set1_epi32(kRound);
+  const __m128i alpha = _mm_set1_epi32(255);
+  const __m128i cy = _mm_set1_epi32(c.y);
+  const __m128i cvr = _mm_set1_epi32(c.vr);
+  const __m128i cug = _mm_set1_epi32(c.ug);
+  const __m128i cvg = _mm_set1_epi32(c.vg);
+  const __m128i cub = _mm_set1_epi32(c.ub);
+
+  int x = 0;
+  for (; x + 4 <= width; x += 4) {
+    __m128i luma = _mm_cvtepu8_epi32(_mm_cvtsi32_si128(Load<int32_t>(y + x)));
+    __m128i u_bytes, v_bytes;
+    if (nv12) {
+      u_bytes = v_bytes = _mm_cvtsi32_si128(Load<int32_t>(chroma.u + x));
+    } else {
+      u_bytes = _mm_cvtsi32_si128(Load<uint16_t>(chroma.u + x / 2));
+      v_bytes = _mm_cvtsi32_si128(Load<uint16_t>(chroma.v + x / 2));
+    }
+    __m128i uu = _mm_sub_epi32(_mm_shuffle_epi8(u_bytes, mask_u), bias);
+    __m128i vv = _mm_sub_epi32(_mm_shuffle_epi8(v_bytes, mask_v), bias);
+
+    __m128i yy = _mm_mullo_epi32(_mm_sub_epi32(luma, y_offset), cy);
+    __m128i r = _mm_add_epi32(_mm_add_epi32(yy, _mm_mullo_epi32(cvr, vv)),
+                              round);
+    __m128i g = _mm_add_epi32(
+        _mm_sub_epi32(_mm_sub_epi32(yy, _mm_mullo_epi32(cug, uu)),
+                      _mm_mullo_epi32(cvg, vv)),
+        round);
+    __m128i b = _mm_add_epi32(_mm_add_epi32(yy, _mm_mullo_epi32(cub, uu)),
+                              round);
+    r = _mm_srai_epi32(r, kShift);
+    g = _mm_srai_epi32(g, kShift);
+    b = _mm_srai_epi32(b, kShift);
+
+    __m128i packed = _mm_packus_epi16(_mm_packs_epi32(r, g),
+                                      _mm_packs_epi32(b, alpha));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + 4 * x),
+                     _mm_shuffle_epi8(packed, to_rgba));
+  }
+  return x;
+}
+
+// 8 pixels per iteration, the packing works per 128 bit lane like RowSse41
+__attribute__((target("avx2"))) int RowAvx2(const uint8_t *y,
+                                            const ChromaRow &chroma,
+                                            uint8_t *dst, int width,
+                                            const Coefficients &c) {
+  const bool nv12 = chroma.step == 2;
+  const __m128i mask_u =
+      nv12 ? _mm_setr_epi8(0, 0, 2, 2, 4, 4, 6, 6, -1, -1, -1, -1, -1, -1, -1,
+                           -1)
+           : _mm_setr_epi8(0, 0, 1, 1, 2, 2, 3, 3, -1, -1, -1, -1, -1, -1, -1,
+                           -1);
+  const __m128i mask_v =
+      nv12 ? _mm_setr_epi8(1, 1, 3, 3, 5, 5, 7, 7, -1, -1, -1, -1, -1, -1, -1,
+                           -1)
+           : mask_u;
+  const __m256i to_rgba =
+      _mm256_setr_epi8(0, 4, 8, 12, 1, 5, 9, 13, 2, 6, 10, 14, 3, 7, 11, 15,
+                       0, 4, 8, 12, 1, 5, 9, 13, 2, 6, 10, 14, 3, 7, 11, 15);
+
+  const __m256i y_offset = _mm256_set1_epi32(c.y_offset);
+  const __m256i bias = _mm256_set1_epi32(128);
+  const __m256i round = _mm256_set1_epi32(kRound);
+  const __m256i alpha = _mm256_set1_epi32(255);
+  const __m256i cy = _mm256_set1_epi32(c.y);
+  const __m256i cvr = _mm256_set1_epi32(c.vr);
+  const __m256i cug = _mm256_set1_epi32(c.ug);
+  const __m256i cvg = _mm256_set1_epi32(c.vg);
+  const __m256i cub = _mm256_set1_epi32(c.ub);
+
+  int x = 0;
+  for (; x + 8 <= width; x += 8) {
+    __m256i luma = _mm256_cvtepu8_epi32(
+        _mm_cvtsi64_si128(Load<int64_t>(y + x)));
+    __m128i u_bytes, v_bytes;
+    if (nv12) {
+      u_bytes = v_bytes = _mm_cvtsi64_si128(Load<int64_t>(chroma.u + x));
+    } else {
+      u_bytes = _mm_cvtsi32_si128(Load<int32_t>(chroma.u + x / 2));
+      v_bytes = _mm_cvtsi32_si128(Load<int32_t>(chroma.v + x / 2));
+    }
+    __m256i uu = _mm256_sub_epi32(
+        _mm256_cvtepu8_epi32(_mm_shuffle_epi8(u_bytes, mask_u)), bias);
+    __m256i vv = _mm256_sub_epi32(
+        _mm256_cvtepu8_epi32(_mm_shuffle_epi8(v_bytes, mask_v)), bias);
+
+    __m256i yy = _mm256_mullo_epi32(_mm256_sub_epi32(luma, y_offset), cy);
+    __m256i r = _mm256_add_epi32(
+        _mm256_add_epi32(yy, _mm256_mullo_epi32(cvr, vv)), round);
+    __m256i g = _mm256_add_epi32(
+        _mm256_sub_epi32(_mm256_sub_epi32(yy, _mm256_mullo_epi32(cug, uu)),
+                         _mm256_mullo_epi32(cvg, vv)),
+        round);
+    __m256i b = _mm256_add_epi32(
+        _mm256_add_epi32(yy, _mm256_mullo_epi32(cub, uu)), round);
+    r = _mm256_srai_epi32(r, kShift);
+    g = _mm256_srai_epi32(g, kShift);
+    b = _mm256_srai_epi32(b, kShift);
+
+    __m256i packed = _mm256_packus_epi16(_mm256_packs_epi32(r, g),
+                                         _mm256_packs_epi32(b, alpha));
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + 4 * x),
+                        _mm256_shuffle_epi8(packed, to_rgba));
+  }
+  return x;
+}
+
+#endif
+
+#if defined(PLAYER_NEON)
+
+// 8 pixels per iteration
+int RowNeon(const uint8_t *y, const ChromaRow &chroma, uint8_t *dst,
+            int width, const Coefficients &c) {
+  const bool nv12 = chroma.step == 2;
+  static constexpr uint8_t kNv12U[] = {0, 0, 2, 2, 4, 4, 6, 6};
+  static constexpr uint8_t kNv12V[] = {1, 1, 3, 3, 5, 5, 7, 7};
+  static constexpr uint8_t kPlanar[] = {0, 0, 1, 1, 2, 2, 3, 3};
+  const uint8x8_t index_u = vld1_u8(nv12 ? kNv12U : kPlanar);
+  const uint8x8_t index_v = vld1_u8(nv12 ? kNv12V : kPlanar);
+
+  const int32x4_t y_offset = vdupq_n_s32(c.y_offset);
+  const int32x4_t bias = vdupq_n_s32(128);
+  const int32x4_t round = vdupq_n_s32(kRound);
+  const int32x4_t cy = vdupq_n_s32(c.y);
+  const int32x4_t cvr = vdupq_n_s32(c.vr);
+  const int32x4_t cug = vdupq_n_s32(c.ug);
+  const int32x4_t cvg = vdupq_n_s32(c.vg);
+  const int32x4_t cub = vdupq_n_s32(c.ub);
+
+  auto widen = [](uint8x8_t bytes, int half) {
+    uint16x8_t wide = vmovl_u8(bytes);
+    return vreinterpretq_s32_u32(
+        vmovl_u16(half == 0 ? vget_low_u16(wide) : vget_high_u16(wide)));
+  };
+  auto narrow = [](int32x4_t low, int32x4_t high) {
+    return vqmovun_s16(vcombine_s16(vqmovn_s32(vshrq_n_s32(low, kShift)),
+                                    vqmovn_s32(vshrq_n_s32(high, kShift))));
+  };
+
+  int x = 0;
+  for (; x + 8 <= width; x += 8) {
+    uint8x8_t luma = vld1_u8(y + x);
+    uint8x8_t u_bytes, v_bytes;
+    if (nv12) {
+      u_bytes = v_bytes = vld1_u8(chroma.u + x);
+    } else {
+      u_bytes = vcreate_u8(Load<uint32_t>(chroma.u + x / 2));
+      v_bytes = vcreate_u8(Load<uint32_t>(chroma.v + x / 2));
+    }
+    u_bytes = vtbl1_u8(u_bytes, index_u);
+    v_bytes = vtbl1_u8(v_bytes, index_v);
+
+    int32x4_t rgb[3][2];
+    for (int half = 0; half < 2; half++) {
+      int32x4_t yy = vmulq_s32(vsubq_s32(widen(luma, half), y_offset), cy);
+      int32x4_t uu = vsubq_s32(widen(u_bytes, half), bias);
+      int32x4_t vv = vsubq_s32(widen(v_bytes, half), bias);
+      rgb[0][half] = vaddq_s32(vmlaq_s32(yy, cvr, vv), round);
+      rgb[1][half] =
+          vaddq_s32(vmlsq_s32(vmlsq_s32(yy, cug, uu), cvg, vv), round);
+      rgb[2][half] = vaddq_s32(vmlaq_s32(yy, cub, uu), round);
+    }
+
+    uint8x8x4_t pixels;
+    pixels.val[0] = narrow(rgb[0][0], rgb[0][1]);
+    pixels.val[1] = narrow(rgb[1][0], rgb[1][1]);
+    pixels.val[2] = narrow(rgb[2][0], rgb[2][1]);
+    pixels.val[3] = vdup_n_u8(255);
+    vst4_u8(dst + 4 * x, pixels);
+  }
+  return x;
+}
+
+#endif
+
+}  // namespace
+
+const char *KernelName(YuvKernel kernel) {
+  switch (kernel) {
+    case YuvKernel::kScalar:
+      return "scalar";
+    case YuvKernel::kSse41:
+      return "sse4.1";
+    case YuvKernel::kAvx2:
+      return "avx2";
+    case YuvKernel::kNeon:
+      return "neon";
+  }
+  return "unknown";
+}
+
+std::vector<YuvKernel> AvailableKernels() {
+  std::vector<YuvKernel> kernels{YuvKernel::kScalar};
+#if defined(PLAYER_X86)
+  if (__builtin_cpu_supports("sse4.1")) {
+    kernels.push_back(YuvKernel::kSse41);
+  }
+  if (__builtin_cpu_supports("avx2")) {
+    kernels.push_back(YuvKernel::kAvx2);
+  }
+#elif defined(PLAYER_NEON)
+  kernels.push_back(YuvKernel::kNeon);
+#endif
+  return kernels;
+}
+
+void ConvertRows(const YuvImage &src, const RgbaImage &dst, YuvMatrix matrix,
+                 YuvRange range, YuvKernel kernel, int first_row,
+                 int last_row) {
+  auto coefficients = MakeCoefficients(matrix, range);
+
+  for (int row = first_row; row < last_row; row++) {
+    const uint8_t *y = src.planes[0] + row * src.strides[0];
+    ChromaRow chroma;
+    if (src.format == YuvFormat::kNv12) {
+      const uint8_t *uv = src.planes[1] + (row / 2) * src.strides[1];
+      chroma = {uv, uv + 1, 2};
+    } else {
+      chroma = {src.planes[1] + (row / 2) * src.strides[1],
+                src.planes[2] + (row / 2) * src.strides[2], 1};
+    }
+    uint8_t *out = dst.pixels + row * dst.stride;
+
+    int x = 0;
+    switch (kernel) {
+#if defined(PLAYER_X86)
+      case YuvKernel::kSse41:
+        x = RowSse41(y, chroma, out, src.width, coefficients);
+        break;
+      case YuvKernel::kAvx2:
+        x = RowAvx2(y, chroma, out, src.width, coefficients);
+        break;
+#elif defined(PLAYER_NEON)
+      case YuvKernel::kNeon:
+        x = RowNeon(y, chroma, out, src.width, coefficients);
+        break;
+#endif
+      default:
+        break;
+    }
+    RowScalar(y, chroma, out, x, src.width, coefficients);
+  }
+}
+
+YuvConverter::YuvConverter(size_t threads)
+    : kernel(AvailableKernels().back()) {
+  if (threads == 0) {
+    threads = std::clamp<size_t>(std::thread::hardware_concurrency(), 1,
+                                 kMaxThreads);
+  }
+  for (size_t band = 1; band < threads; band++) {
+    workers.emplace_back(&YuvConverter::Run, this, band);
+  }
+}
+
+YuvConverter::~YuvConverter() {
+  {
+    std::lock_guard lock{mutex};
+    stop = true;
+  }
+  start_cv.notify_all();
+  for (auto &worker : workers) {
+    worker.join();
+  }
+}
+
+void YuvConverter::Convert(const YuvImage &src, const RgbaImage &dst,
+                           YuvMatrix matrix, YuvRange range) {
+  {
+    std::lock_guard lock{mutex};
+    job_src = &src;
+    job_dst = &dst;
+    job_matrix = matrix;
+    job_range = range;
+    pending = workers.size();
+    generation++;
+  }
+  start_cv.notify_all();
+
+  ConvertBand(0);
+
+  std::unique_lock lock{mutex};
+  done_cv.wait(lock, [this] { return pending == 0; });
+}
+
+void YuvConverter::Run(size_t band) {
+  uint64_t seen = 0;
+  while (true) {
+    {
+      std::unique_lock lock{mutex};
+      start_cv.wait(lock, [&] { return stop || generation != seen; });
+      if (stop) {
+        return;
+      }
+      seen = generation;
+    }
+
+    ConvertBand(band);
+
+    std::lock_guard lock{mutex};
+    if (--pending == 0) {
+      done_cv.notify_one();
+    }
+  }
+}
+
+void YuvConverter::ConvertBand(size_t band) {
+  // bands start on even rows so no chroma row is shared
+  size_t pairs = (job_src->height + 1) / 2;
+  size_t bands = Threads();
+  int first = static_cast<int>(pairs * band / bands * 2);
+  int last = std::min(job_src->height,
+                      static_cast<int>(pairs * (band + 1) / bands * 2));
+  ConvertRows(*job_src, *job_dst, job_matrix, job_range, kernel, first, last);
+}
+
+}  // namespace player
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace player {
+
+enum class YuvFormat { kNv12, kI420 };
+enum class YuvMatrix { kBt601, kBt709 };
+enum class YuvRange { kLimited, kFull };
+
+// SIMD kernels produce exactly the same pixels as the scalar one, they share
+// the 16 bit fixed point coefficients.
+enum class YuvKernel { kScalar, kSse41, kAvx2, kNeon };
+
+// 4:2:0 frame, NV12 uses planes[1] for the interleaved chroma.
+struct YuvImage {
+  YuvFormat format;
+  int width;
+  int height;
+  const uint8_t *planes[3];
+  int strides[3];
+};
+
+struct RgbaImage {
+  uint8_t *pixels;
+  int stride;
+};
+
+const char *KernelName(YuvKernel kernel);
+
+// Kernels the CPU supports, the fastest last.
+std::vector<YuvKernel> AvailableKernels();
+
+void ConvertRows(const YuvImage &src, const RgbaImage &dst, YuvMatrix matrix,
+                 YuvRange range, YuvKernel kernel, int first_row,
+                 int last_row);
+
+// Converts frames with the fastest kernel, split into row bands over a pool
+// of worker threads. The calling thread converts the first band.
+class YuvConverter {
+ public:
+  // 0 picks one thread per core, up to 4
+  explicit YuvConverter(size_t threads = 0);
+  ~YuvConverter();
+
+  YuvConverter(const YuvConverter &other) = delete;
+  YuvConverter &operator=(const YuvConverter &) = delete;
+
+  void Convert(const YuvImage &src, const RgbaImage &dst, YuvMatrix matrix,
+               YuvRange range);
+
+  YuvKernel Kernel() const { return kernel; }
+  void SetKernel(YuvKernel kernel) { this->kernel = kernel; }
+  size_t Threads() const { return workers.size() + 1; }
+
+ private:
+  void Run(size_t band);
+  void ConvertBand(size_t band);
+
+  YuvKernel kernel;
+
+  std::mutex mutex;
+  std::condition_variable start_cv;
+  std::condition_variable done_cv;
+  uint64_t generation = 0;
+  size_t pending = 0;
+  bool stop = false;
+
+  // the current job, set before workers are woken
+  const YuvImage *job_src = nullptr;
+  const RgbaImage *job_dst = nullptr;
+  YuvMatrix job_matrix = YuvMatrix::kBt601;
+  YuvRange job_range = YuvRange::kLimited;
+
+  std::vector<std::thread> workers;
+};
+
+}  // namespace player